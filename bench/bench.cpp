@@ -0,0 +1,698 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "defines.h"
+#include "fiber.h"
+#include "fiberbvh.h"
+#include "hopf.h"
+#include "mesh.h"
+#include "misc.h"
+#include "offscreen.h"
+#include "renderer.h"
+#include "shader.h"
+
+/**********************************************************************************
+ *
+ * Micro-benchmarks for each stage of the fibration pipeline.
+ *
+ * Usage: hopf_bench [--json <file>] [--filter <substring>] [--shaders <dir>] [--no-gl] [--software]
+ *
+ * GPU cases run in a surfaceless context (see createHeadlessContext), so no
+ * display server is needed.
+ *
+ **********************************************************************************/
+
+// Results are accumulated here so the compiler cannot discard the work.
+static volatile float g_sink = 0;
+
+static std::vector<vec3> basePoints(size_t count)
+{
+    std::vector<vec3> points(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        float t = (float)i/(float)count;
+        points[i] = S2(2*PI*t, PI/4 + PI/8*std::sin(10*PI*t));
+    }
+    return points;
+}
+
+static void benchMisc(BenchRunner& runner)
+{
+    const int batch = 1024;
+
+    runner.run("misc/rotation", {{"items_per_second", batch}}, [&]()
+    {
+        float acc = 0;
+        for (int i = 0; i < batch; i++)
+            acc += rotation(vec3(1,0,1), 1e-3f*i)[0][0];
+        g_sink = acc;
+    });
+
+    runner.run("misc/exp_mat3", {{"items_per_second", batch}}, [&]()
+    {
+        float acc = 0;
+        for (int i = 0; i < batch; i++)
+            acc += exp(mat3(1e-3f*i))[1][1];
+        g_sink = acc;
+    });
+
+    runner.run("misc/S2", {{"items_per_second", batch}}, [&]()
+    {
+        float acc = 0;
+        for (int i = 0; i < batch; i++)
+            acc += S2(1e-3f*i, 2e-3f*i).z;
+        g_sink = acc;
+    });
+}
+
+static void benchMesh(BenchRunner& runner)
+{
+    auto sphereParam = [](float u, float v)
+    {
+        return S2(2*PI*v,PI*u);
+    };
+
+    for (int n : {16, 64, 256})
+    {
+        runner.run("mesh/meshFromSurface/" + std::to_string(n) + "x" + std::to_string(n),
+            {{"vertices_per_second", (double)(n*n)}}, [&]()
+        {
+            auto mesh = meshFromSurface(sphereParam,n,n,1,0);
+            g_sink = mesh.first.back().position.x;
+        });
+    }
+}
+
+static void benchFibersCPU(BenchRunner& runner)
+{
+    for (uint fiberCount : {100u, 1000u, 10000u})
+    {
+        for (uint fiberRes : {100u, (uint)FIBER_SIZE})
+        {
+            std::vector<vec3> points = basePoints(fiberCount);
+            std::vector<Vertex> vertices(fiberCount*fiberRes);
+
+            runner.run("fibers/cpu/" + std::to_string(fiberCount) + "x" + std::to_string(fiberRes),
+                {{"fibers_per_second", (double)fiberCount},{"vertices_per_second", (double)(fiberCount*fiberRes)}}, [&]()
+            {
+                sampleFibers(points.data(), fiberCount, fiberRes, vertices.data());
+                g_sink = vertices.back().position.x;
+            });
+        }
+    }
+}
+
+// Samples per fiber when the index queries are checked by brute force.
+#define INDEX_CHECK_SAMPLES 4096
+
+/**
+ * Distance from p to the centre line of a fiber, computed independently of
+ * FiberIndex for checking its queries.
+ */
+static float fiberLineDistance(const FiberCircle<float>& fiber, vec3 p)
+{
+    vec3 d = p - fiber.center;
+
+    if (fiber.isLine)
+        return glm::length(d - glm::dot(d, fiber.axis)*fiber.axis);
+
+    float h = glm::dot(d, fiber.normal);
+    float rho = glm::length(d - h*fiber.normal);
+    return std::sqrt(h*h + (rho - fiber.radius)*(rho - fiber.radius));
+}
+
+/**
+ * Smallest distance from the sampled centre line of a fiber to the box
+ * [lo,hi]; 0 if a sample lies inside.
+ */
+static float fiberBoxDistance(const FiberCircle<float>& fiber, vec3 lo, vec3 hi)
+{
+    float best = std::numeric_limits<float>::infinity();
+
+    for (int i = 0; i < INDEX_CHECK_SAMPLES; i++)
+    {
+        // Open interval, so lines stay finite.
+        float t = 2*PI*((float)i + 0.5f)/INDEX_CHECK_SAMPLES - PI;
+        vec3 p = fiber.point(t);
+        best = std::min(best, glm::length(glm::max(glm::max(lo - p, p - hi), vec3(0))));
+    }
+    return best;
+}
+
+/**
+ * The picking index as HopfSimulation uses it: built for new points, refit
+ * for each rotation, and queried along rays from a viewpoint like the
+ * scene camera's.  The nearest, box and sphere queries are checked against
+ * a scan of every fiber before they are timed.  Returns false if any of
+ * them disagrees with the scan.
+ */
+static bool benchFiberIndex(BenchRunner& runner)
+{
+    const float radius = 0.03f;     // FIBER_PICK_RADIUS
+    const int rays = 64;
+    const int queries = 16;
+    const float queryRadius = 0.01f;
+    const float tolerance = 1e-5f;
+
+    bool ok = true;
+
+    for (uint fiberCount : {100u, 1000u, 10000u, 1000000u})
+    {
+        std::vector<vec3> points = basePoints(fiberCount);
+        std::string suffix = std::to_string(fiberCount);
+
+        runner.run("index/build/" + suffix, {{"fibers_per_second", (double)fiberCount}}, [&]()
+        {
+            FiberIndex index;
+            index.build(points, radius);
+            g_sink = (float)index.nodeCount();
+        });
+
+        // Small steps, as between animated frames, so the tree is refit
+        // rather than rebuilt.
+        FiberIndex index;
+        index.build(points, radius);
+
+        std::vector<vec3> rotated(fiberCount);
+        int step = 0;
+
+        runner.run("index/refit/" + suffix, {{"fibers_per_second", (double)fiberCount}}, [&]()
+        {
+            mat3 r = rotation(vec3(0,0,1), 1e-3f*(float)(step++ % 64));
+            for (uint i = 0; i < fiberCount; i++)
+                rotated[i] = r*points[i];
+
+            index.update(rotated);
+            g_sink = index.circle(0).radius;
+        });
+
+        index.build(points, radius);
+
+        std::vector<Ray> pickRays(rays);
+        vec3 eye(-5,5,0);
+        for (int i = 0; i < rays; i++)
+        {
+            float t = (float)i/(float)rays;
+            vec3 target = 0.5f*vec3(std::cos(2*PI*t), std::sin(6*PI*t), std::sin(2*PI*t));
+            pickRays[i] = {eye, glm::normalize(target - eye), 1e4f};
+        }
+
+        runner.run("index/pick/" + suffix, {{"rays_per_second", (double)rays}}, [&]()
+        {
+            uint32_t hits = 0;
+            for (const Ray& ray : pickRays)
+            {
+                float t;
+                hits += index.pick(ray, t) != FIBER_BVH_MISS;
+            }
+            g_sink = (float)hits;
+        });
+
+        // Query points just off fibers spread over the whole set, so every
+        // query has fibers nearby.
+        std::vector<vec3> centers(queries);
+        for (int i = 0; i < queries; i++)
+        {
+            const FiberCircle<float>& circle = index.circle((uint32_t)((size_t)i*fiberCount/queries));
+            centers[i] = circle.point(0.4f*(float)i) + 0.5f*queryRadius*vec3(1,-1,1);
+        }
+
+        // Checked once, untimed.
+        size_t mismatches = 0;
+        std::vector<uint32_t> found;
+
+        for (vec3 center : centers)
+        {
+            vec3 lo = center - vec3(queryRadius);
+            vec3 hi = center + vec3(queryRadius);
+
+            std::vector<float> distances(fiberCount);
+            float nearestScan = 2*queryRadius;
+            for (uint32_t f = 0; f < fiberCount; f++)
+            {
+                distances[f] = fiberLineDistance(index.circle(f), center);
+                nearestScan = std::min(nearestScan, distances[f]);
+            }
+
+            float nearestIndex;
+            if (index.nearest(center, 2*queryRadius, nearestIndex) == FIBER_BVH_MISS ||
+                std::abs(nearestIndex - nearestScan) > tolerance)
+                mismatches++;
+
+            // Fibers right at the boundary may land either way.
+            found.clear();
+            index.querySphere(center, queryRadius, found);
+            std::vector<bool> inSphere(fiberCount, false);
+            for (uint32_t f : found)
+                inSphere[f] = true;
+
+            for (uint32_t f = 0; f < fiberCount; f++)
+                if (inSphere[f] != (distances[f] <= queryRadius) && std::abs(distances[f] - queryRadius) > tolerance)
+                    mismatches++;
+
+            // Samples are a chord apart, so a fiber crossing only a corner of
+            // the box may miss every sample; it must still come within one.
+            // Fibers farther from the centre than the box's corners cannot
+            // cross it and are not sampled.
+            found.clear();
+            index.queryBox(lo, hi, found);
+            std::vector<bool> inBox(fiberCount, false);
+            for (uint32_t f : found)
+                inBox[f] = true;
+
+            float reach = queryRadius*std::sqrt(3.0f) + tolerance;
+            for (uint32_t f = 0; f < fiberCount; f++)
+            {
+                const FiberCircle<float>& circle = index.circle(f);
+                if (distances[f] > reach)
+                {
+                    mismatches += inBox[f];
+                    continue;
+                }
+
+                float d = fiberBoxDistance(circle, lo, hi);
+                float chord = circle.isLine ? queryRadius : 2*PI*circle.radius/INDEX_CHECK_SAMPLES;
+
+                if (d == 0 ? !inBox[f] : (inBox[f] && d > chord))
+                    mismatches++;
+            }
+        }
+
+        runner.record("index/check/" + suffix, {{"mismatches", (double)mismatches}});
+
+        if (mismatches)
+        {
+            fprintf(stderr, "ERROR: fiber index queries disagree with a scan in %zu cases at %u fibers\n", mismatches, fiberCount);
+            ok = false;
+        }
+
+        runner.run("index/nearest/" + suffix, {{"queries_per_second", (double)queries}}, [&]()
+        {
+            float acc = 0;
+            for (vec3 center : centers)
+            {
+                float distance;
+                index.nearest(center, 2*queryRadius, distance);
+                acc += distance;
+            }
+            g_sink = acc;
+        });
+
+        runner.run("index/sphere/" + suffix, {{"queries_per_second", (double)queries}}, [&]()
+        {
+            found.clear();
+            for (vec3 center : centers)
+                index.querySphere(center, queryRadius, found);
+            g_sink = (float)found.size();
+        });
+
+        runner.run("index/box/" + suffix, {{"queries_per_second", (double)queries}}, [&]()
+        {
+            found.clear();
+            for (vec3 center : centers)
+                index.queryBox(center - vec3(queryRadius), center + vec3(queryRadius), found);
+            g_sink = (float)found.size();
+        });
+    }
+
+    return ok;
+}
+
+/**
+ * Point t on the fiber over p, sampled in extended precision.  Near the pole
+ * 1 - w cancels badly, so it is rewritten as (1 - r2) + r2*(1 - sin(phi)).
+ */
+static glm::dvec3 referenceSample(glm::dvec3 p, double t)
+{
+    const long double pi = 3.141592653589793238462643383279502884L;
+
+    long double a = p.z, b = p.y, c = p.x;
+    long double rho = std::sqrt(b*b + c*c);
+    long double r2 = std::sqrt((1 - a)/2);
+    long double r1 = a >= 0 ? std::sqrt((1 + a)/2) : rho/(2*r2);
+    long double phi = std::atan2(-c, b) - (long double)t;
+    long double s = std::sin(pi/4 - phi/2);
+    long double oneMinusW = r1*r1/(1 + r2) + 2*r2*s*s;
+
+    return glm::dvec3(
+        (double)(r1*std::cos((long double)t)/oneMinusW),
+        (double)(r1*std::sin((long double)t)/oneMinusW),
+        (double)(r2*std::cos(phi)/oneMinusW));
+}
+
+/**
+ * Throughput of the closed-form circles, and their worst relative error
+ * against fibers sampled directly in extended precision.  Returns false when
+ * the error exceeds the documented bound.
+ */
+static bool benchFiberCircles(BenchRunner& runner)
+{
+    for (uint fiberCount : {1000u, 100000u})
+    {
+        std::vector<vec3> points = basePoints(fiberCount);
+        std::vector<glm::dvec3> pointsD(points.begin(), points.end());
+        std::vector<FiberCircle<float>> circles(fiberCount);
+        std::vector<FiberCircle<double>> circlesD(fiberCount);
+
+        runner.run("fibers/closed_form/float/" + std::to_string(fiberCount), {{"fibers_per_second", (double)fiberCount}}, [&]()
+        {
+            fiberCircles(points.data(), fiberCount, circles.data());
+            g_sink = circles.back().radius;
+        });
+
+        runner.run("fibers/closed_form/double/" + std::to_string(fiberCount), {{"fibers_per_second", (double)fiberCount}}, [&]()
+        {
+            fiberCircles(pointsD.data(), fiberCount, circlesD.data());
+            g_sink = (float)circlesD.back().radius;
+        });
+    }
+
+    // Include base points right next to the projection pole, where the old
+    // three-point fit broke down.
+    std::vector<glm::dvec3> points;
+    for (uint i = 0; i < 4096; i++)
+    {
+        float t = (float)i/4096.0f;
+        points.push_back(glm::normalize(glm::dvec3(S2(2*PI*t, PI*t))));
+        points.push_back(glm::normalize(glm::dvec3(1e-4*std::cos(2*PI*t), 1e-4*std::sin(2*PI*t), -1)));
+    }
+
+    double errorF = 0, errorD = 0;
+
+    for (const glm::dvec3& p : points)
+    {
+        FiberCircle<float> circleF = fiberCircle(vec3(p));
+        FiberCircle<double> circleD = fiberCircle(p);
+
+        for (int j = 0; j < 32; j++)
+        {
+            double t = 2*M_PI*j/32.0;
+            glm::dvec3 sample = referenceSample(p, t);
+
+            glm::dvec3 d = sample - circleD.center;
+            errorD = std::max(errorD, (std::abs(glm::length(d) - circleD.radius) + std::abs(glm::dot(d,circleD.normal)))/circleD.radius);
+
+            glm::dvec3 dF = sample - glm::dvec3(circleF.center);
+            double radiusF = circleF.radius;
+            errorF = std::max(errorF, (std::abs(glm::length(dF) - radiusF) + std::abs(glm::dot(dF,glm::dvec3(circleF.normal))))/radiusF);
+        }
+    }
+
+    const double boundF = 1e-6;
+    const double boundD = 1e-8;
+
+    runner.record("fibers/closed_form/error", {
+        {"max_relative_error_float", errorF},
+        {"max_relative_error_double", errorD}
+    });
+
+    if (errorF > boundF || errorD > boundD)
+    {
+        fprintf(stderr, "ERROR: closed-form fiber error above bound (float %g > %g or double %g > %g)\n",
+            errorF, boundF, errorD, boundD);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * GPU buffers for one fiber count/resolution, laid out the same way as in
+ * HopfFibrationDisplay.
+ */
+struct FiberBuffers
+{
+    FiberBuffers(uint fiberCount, uint fiberRes, uint detail)
+    {
+        std::vector<SpherePointData> pointData(fiberCount);
+        std::vector<vec3> positions = basePoints(fiberCount);
+        for (uint i = 0; i < fiberCount; i++)
+            pointData[i] = {vec4(positions[i],1), vec4(1)};
+        points.uploadData(pointData);
+
+        std::vector<InstanceLine> instanceData(fiberCount);
+        for (uint i = 0; i < fiberCount; i++)
+        {
+            instanceData[i] = {
+                .cmd = {
+                .count = fiberRes,
+                .instanceCount = 1,
+                .first = i*fiberRes,
+                .baseInstance = 0
+                },
+                .width = 0.02f,
+                .avgLength = 0
+            };
+        }
+        instances.uploadData(instanceData);
+
+        size_t vertexCount = fiberCount*fiberRes;
+        circleVertices.reserve(vertexCount*sizeof(Vertex));
+        circleIndices.reserve(6*vertexCount*sizeof(uint));
+        frames.reserve(vertexCount*sizeof(TangentFrame));
+        tubeVertices.reserve(detail*vertexCount*sizeof(Vertex));
+        tubeIndices.reserve(6*detail*vertexCount*sizeof(uint));
+    }
+
+    Buffer points;
+    Buffer instances;
+    Buffer circleVertices;
+    Buffer circleIndices;
+    Buffer frames;
+    Buffer tubeVertices;
+    Buffer tubeIndices;
+};
+
+/**
+ * Rotation of the control points, as SphereController::transformPoints
+ * dispatches it.
+ */
+static void benchSpheresGL(BenchRunner& runner, ShaderManager& shaders)
+{
+    ShaderProgram transform = shaders.program("spheres_transform");
+
+    for (uint pointCount : {100u, 10000u, 1000000u})
+    {
+        std::vector<SpherePointData> pointData(pointCount);
+        std::vector<vec3> positions = basePoints(pointCount);
+        for (uint i = 0; i < pointCount; i++)
+            pointData[i] = {vec4(positions[i],1), vec4(1)};
+
+        Buffer base, points;
+        base.uploadData(pointData);
+        points.reserve(pointCount*sizeof(SpherePointData));
+
+        glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,points.id());
+        glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,base.id());
+
+        runner.run("gl/spheres_transform/" + std::to_string(pointCount), {{"items_per_second", (double)pointCount}}, [&]()
+        {
+            transform.use();
+            transform.setUniform("first",0u);
+            transform.setUniform("count",pointCount);
+            transform.setUniform("u_rotation",rotation(vec3(1,0,1), 0.1f),GL_FALSE);
+            transform.dispatchCompute(pointCount, 1, 1);
+            glFinish();
+        });
+    }
+}
+
+static void benchFibersGL(BenchRunner& runner, ShaderManager& shaders)
+{
+    const uint detail = 8;
+
+    ShaderProgram hopf = shaders.program("hopf");
+    ShaderProgram normals = shaders.program("fiber_normals");
+    ShaderProgram tangents = shaders.program("polyline_0_tangents");
+    ShaderProgram frames = shaders.program("polyline_1_normals");
+    ShaderProgram tubes = shaders.program("polyline_2_mesh");
+    ShaderProgram fused = shaders.program("fiber_fused");
+    ShaderProgram fusedDetail = shaders.program("fiber_fused", {{"LINE_DETAIL", std::to_string(detail)}});
+
+    for (uint fiberCount : {100u, 1000u})
+    {
+        for (uint fiberRes : {100u, (uint)FIBER_SIZE})
+        {
+            FiberBuffers buffers(fiberCount, fiberRes, detail);
+            std::string suffix = std::to_string(fiberCount) + "x" + std::to_string(fiberRes);
+
+            double fibers = fiberCount;
+            double vertices = fiberCount*fiberRes;
+
+            runner.run("gl/hopf/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", vertices}}, [&]()
+            {
+                glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,buffers.points.id());
+                glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,buffers.instances.id());
+                glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,2,buffers.circleVertices.id());
+                glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,3,buffers.circleIndices.id());
+                hopf.use();
+                hopf.setUniform("numFibers",fiberCount);
+                hopf.dispatchCompute(fiberRes, 1, fiberCount);
+                glFinish();
+            });
+
+            runner.run("gl/fiber_normals/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", vertices}}, [&]()
+            {
+                glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,buffers.circleVertices.id());
+                glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,buffers.instances.id());
+                normals.use();
+                normals.setUniform("numFibers",fiberCount);
+                normals.dispatchCompute(fiberRes, 1, fiberCount);
+                glFinish();
+            });
+
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,buffers.circleVertices.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,buffers.instances.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,2,buffers.frames.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,3,buffers.tubeVertices.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,4,buffers.tubeIndices.id());
+
+            runner.run("gl/polyline_0_tangents/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", vertices}}, [&]()
+            {
+                tangents.use();
+                tangents.setUniform("numLines",fiberCount);
+                tangents.dispatchCompute(fiberRes, 1, fiberCount);
+                glFinish();
+            });
+
+            runner.run("gl/polyline_1_normals/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", vertices}}, [&]()
+            {
+                frames.use();
+                frames.setUniform("numLines",fiberCount);
+                frames.dispatchCompute(1, 1, fiberCount);
+                glFinish();
+            });
+
+            runner.run("gl/polyline_2_mesh/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", detail*vertices}}, [&]()
+            {
+                tubes.use();
+                tubes.setUniform("numLines",fiberCount);
+                tubes.setUniform("lineDetail",detail);
+                tubes.dispatchCompute(fiberRes, detail, fiberCount);
+                glFinish();
+            });
+
+            // All five passes above in one dispatch
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,buffers.points.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,buffers.instances.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,2,buffers.circleVertices.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,3,buffers.circleIndices.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,4,buffers.tubeVertices.id());
+            glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,5,buffers.tubeIndices.id());
+
+            runner.run("gl/fiber_fused/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", vertices}}, [&]()
+            {
+                fused.use();
+                fused.setUniform("numFibers",fiberCount);
+                fused.setUniform("lineDetail",detail);
+                fused.dispatchCompute(1, 1, fiberCount);
+                glFinish();
+            });
+
+            runner.run("gl/fiber_fused_detail/" + suffix, {{"fibers_per_second", fibers},{"vertices_per_second", vertices}}, [&]()
+            {
+                fusedDetail.use();
+                fusedDetail.setUniform("numFibers",fiberCount);
+                fusedDetail.dispatchCompute(1, 1, fiberCount);
+                glFinish();
+            });
+
+        }
+    }
+}
+
+/**
+ * GPU counterpart of benchMesh: the same sphere and grid sizes through
+ * MeshGen::surfaceMesh.
+ */
+static void benchMeshGL(BenchRunner& runner, ShaderManager& shaders)
+{
+    MeshGen meshGen;
+    meshGen.setShaderManager(&shaders);
+
+    for (uint n : {16u, 64u, 256u, 1024u})
+    {
+        Mesh mesh;
+
+        runner.run("gl/surface_mesh/" + std::to_string(n) + "x" + std::to_string(n),
+            {{"vertices_per_second", (double)(n*n)}}, [&]()
+        {
+            meshGen.surfaceMesh(mesh, SURFACE_SPHERE, n, n, 1, 0);
+            glFinish();
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* jsonPath = nullptr;
+    std::string shaderPath = "../graphics/shader/";
+    bool useGL = true;
+    bool software = false;
+
+    BenchRunner runner;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i],"--json") && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (!strcmp(argv[i],"--filter") && i + 1 < argc)
+            runner.setFilter(argv[++i]);
+        else if (!strcmp(argv[i],"--shaders") && i + 1 < argc)
+            shaderPath = argv[++i];
+        else if (!strcmp(argv[i],"--no-gl"))
+            useGL = false;
+        else if (!strcmp(argv[i],"--software"))
+            software = true;
+        else {
+            fprintf(stderr, "usage: %s [--json <file>] [--filter <substring>] [--shaders <dir>] [--no-gl] [--software]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    benchMisc(runner);
+    benchMesh(runner);
+    benchFibersCPU(runner);
+    bool indexOk = benchFiberIndex(runner);
+    bool circlesOk = benchFiberCircles(runner);
+
+    HeadlessContext* context = useGL ? createHeadlessContext(software) : nullptr;
+    bool programsOk = true;
+
+    if (context)
+    {
+        printf("Renderer: %s\n", glGetString(GL_RENDERER));
+
+        {
+            ShaderManager shaders(shaderPath);
+
+            programsOk = addHopfPrograms(shaders);
+
+            if (programsOk)
+            {
+                benchMeshGL(runner, shaders);
+                benchSpheresGL(runner, shaders);
+                benchFibersGL(runner, shaders);
+            }
+            else
+                fprintf(stderr, "ERROR: shader programs failed to build, skipping GPU benchmarks\n");
+        }
+
+        destroyHeadlessContext(context);
+    }
+    else if (useGL)
+    {
+        fprintf(stderr, "WARNING: no GL context available, skipping GPU benchmarks\n");
+    }
+
+    if (jsonPath && !runner.writeJson(jsonPath))
+        return 1;
+
+    return circlesOk && indexOk && programsOk ? 0 : 1;
+}
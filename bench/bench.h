@@ -0,0 +1,149 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**********************************************************************************
+ *
+ * Minimal benchmark harness.  Each benchmark is a callable that performs one
+ * iteration of work; it is repeated until a minimum wall time has elapsed and
+ * throughput counters are scaled by the per-iteration item counts.
+ *
+ **********************************************************************************/
+
+struct BenchCounter
+{
+    std::string name;     // e.g. "fibers_per_second"
+    double perIteration;  // Items processed by one call
+};
+
+struct BenchResult
+{
+    std::string name;
+    size_t iterations;
+    double nsPerIteration;
+    std::vector<std::pair<std::string,double>> rates;
+};
+
+class BenchRunner
+{
+public:
+    BenchRunner(double minSeconds = 0.25) : m_minSeconds(minSeconds) {}
+
+    /**
+     * Only run benchmarks whose name contains filter.
+     */
+    void setFilter(const std::string& filter) {m_filter = filter;}
+
+    void run(const std::string& name, const std::vector<BenchCounter>& counters, const std::function<void()>& fn);
+
+    /**
+     * Record measured values (e.g. error bounds) that are not timings.
+     */
+    void record(const std::string& name, const std::vector<std::pair<std::string,double>>& values);
+
+    const std::vector<BenchResult>& results() const {return m_results;}
+
+    /**
+     * Write all results as JSON.  The layout follows Google Benchmark's so
+     * existing comparison tooling can read it.
+     */
+    bool writeJson(const char* path) const;
+
+private:
+    double m_minSeconds;
+    std::string m_filter;
+    std::vector<BenchResult> m_results;
+};
+
+inline void BenchRunner::run(const std::string& name, const std::vector<BenchCounter>& counters, const std::function<void()>& fn)
+{
+    if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+        return;
+
+    using clock = std::chrono::steady_clock;
+
+    // Warm up caches, shader pipelines, etc.
+    fn();
+
+    size_t iterations = 1;
+    double elapsed = 0;
+
+    while (true)
+    {
+        auto start = clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            fn();
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+        if (elapsed >= m_minSeconds || iterations >= ((size_t)1 << 30))
+            break;
+
+        iterations *= 2;
+    }
+
+    BenchResult result = {
+        .name = name,
+        .iterations = iterations,
+        .nsPerIteration = 1e9*elapsed/(double)iterations
+    };
+
+    for (const BenchCounter& counter : counters)
+        result.rates.push_back({counter.name, counter.perIteration*(double)iterations/elapsed});
+
+    printf("%-48s %12zu it %14.1f ns/it", name.c_str(), result.iterations, result.nsPerIteration);
+    for (auto& rate : result.rates)
+        printf("  %s=%.4g", rate.first.c_str(), rate.second);
+    printf("\n");
+
+    m_results.push_back(std::move(result));
+}
+
+inline void BenchRunner::record(const std::string& name, const std::vector<std::pair<std::string,double>>& values)
+{
+    if (!m_filter.empty() && name.find(m_filter) == std::string::npos)
+        return;
+
+    printf("%-48s", name.c_str());
+    for (auto& value : values)
+        printf("  %s=%.4g", value.first.c_str(), value.second);
+    printf("\n");
+
+    m_results.push_back({.name = name, .iterations = 1, .nsPerIteration = 0, .rates = values});
+}
+
+inline bool BenchRunner::writeJson(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+
+    if (!file) {
+        fprintf(stderr, "ERROR: could not open file: %s \n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < m_results.size(); i++)
+    {
+        const BenchResult& result = m_results[i];
+
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"name\": \"%s\",\n", result.name.c_str());
+        fprintf(file, "      \"iterations\": %zu,\n", result.iterations);
+        fprintf(file, "      \"real_time\": %.3f,\n", result.nsPerIteration);
+        fprintf(file, "      \"time_unit\": \"ns\"");
+        for (auto& rate : result.rates)
+            fprintf(file, ",\n      \"%s\": %.6g", rate.first.c_str(), rate.second);
+        fprintf(file, "\n    }%s\n", i + 1 < m_results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    fclose(file);
+    return true;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+
+/**********************************************************************************
+ *
+ * Work group size autotuning.  Compute shaders take their local size from
+ * LOCAL_SIZE_X/Y/Z defines, so every candidate is just a ShaderManager
+ * variant.  The tuner times each candidate with GPU timer queries and keeps
+ * the fastest per renderer, kernel and configuration in a small text file.
+ *
+ **********************************************************************************/
+
+/**
+ * Defines selecting a local size of x*y*z.
+ */
+extern ShaderDefines localSizeDefines(uint x, uint y = 1, uint z = 1);
+
+class WorkGroupTuner
+{
+public:
+    /**
+     * Needs a current GL context, whose GL_RENDERER string keys the results.
+     *
+     * @param cachePath - File the results are loaded from and saved to.
+     */
+    WorkGroupTuner(const std::string& cachePath);
+
+    /**
+     * Read previously saved results.  Returns false if there is no cache.
+     */
+    bool load();
+
+    /**
+     * Write every result back, including those of other renderers.
+     */
+    bool save() const;
+
+    /**
+     * Fastest candidate recorded for kernel under config on this renderer,
+     * or nullptr if it was never tuned.
+     */
+    const ShaderDefines* best(const std::string& kernel, const std::string& config) const;
+
+    /**
+     * Time each candidate and record the fastest for kernel under config.
+     * dispatch must issue the kernel's work compiled with the given defines,
+     * or return false if that variant could not be built; it is called once
+     * untimed first, so compilation is not measured.  Candidates that fail
+     * to build or exceed the device limits are skipped.  Returns the winner, or an empty set if none ran.
+     *
+     * @param kernel - Name the result is stored under.
+     * @param config - Describes the workload, e.g. its fiber count.
+     */
+    ShaderDefines tune(
+        const std::string& kernel,
+        const std::string& config,
+        const std::vector<ShaderDefines>& candidates,
+        const std::function<bool(const ShaderDefines&)>& dispatch);
+
+    const std::string& renderer() const {return m_renderer;}
+
+private:
+    struct Result
+    {
+        std::string renderer;
+        std::string kernel;
+        std::string config;
+        ShaderDefines defines;
+    };
+
+    std::string m_cachePath;
+    std::string m_renderer;
+    std::vector<Result> m_results;
+};
+
+#endif
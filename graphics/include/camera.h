@@ -6,6 +6,8 @@
 #include <GL/glew.h> 
 #include <GLFW/glfw3.h> 
 
+#include "globject.h"
+
 struct CameraUBOLayout
 {
     mat4 view;
@@ -17,6 +19,10 @@ struct CameraUBOLayout
 	float far;
 };
 
+/**
+ * Move-only, since it owns its uniform buffer.  The buffer is created by
+ * the first updateUbo(), so cameras may be made before a context exists.
+ */
 struct Camera {
 public:
 	Camera() {}
@@ -29,24 +35,38 @@ public:
 		GLfloat near = 1,
 		GLfloat far = 500
 	);
-	~Camera();
 
-	Camera& operator=(const Camera& other);
+	Camera(Camera&&) = default;
+	Camera& operator=(Camera&&) = default;
 
+	/**
+	 * Bind the uniform buffer, as of the last updateUbo().
+	 */
 	void bindUbo(GLuint binding) const;
 	void rotate(float pitch, float yaw);
 	void translate(vec3 delta,float speed);
 	mat4 getViewMatrix() const;
 	mat4 getProjMatrix() const;
+
+	/**
+	 * Restrict the projection to the part of the view between ndcMin and
+	 * ndcMax (in normalized device coordinates), stretched to fill the
+	 * viewport.  Used to render large images in tiles; (-1,-1),(1,1) is the
+	 * whole view.
+	 */
+	void setSubFrustum(vec2 ndcMin, vec2 ndcMax);
 	vec3 coord(int i) const {return vec3(coords[i]);}
 
 	void resize(int width, int height);
 	void updateUbo();
 
 	float fov, aspect, near, far;
+	vec2 subMin = vec2(-1), subMax = vec2(1);
 	vec3 position;
 	mat4 coords;
-	GLuint ubo;
+
+private:
+	GLBuffer m_ubo;
 };
 
 
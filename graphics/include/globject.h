@@ -0,0 +1,161 @@
+#ifndef GLOBJECT_H
+#define GLOBJECT_H
+
+#include <GL/glew.h>
+
+#include <unordered_set>
+
+/**********************************************************************************
+ *
+ * Ownership of GL object names.  A GLHandle owns one name, creates it the
+ * first time it is asked for it and deletes it when destroyed.  Handles are
+ * move-only: a moved-from handle is empty, and copying a class that owns GL
+ * objects does not compile instead of deleting them twice.  Since nothing is
+ * created up front, objects holding handles may be constructed, moved into
+ * containers and assigned before a context exists without any GL calls.
+ *
+ * Every name created and deleted through a handle is counted by
+ * glObjects().  Debug builds also keep the live names, so deleting a name
+ * twice or one that was never created is reported.
+ *
+ **********************************************************************************/
+
+enum GLObjectType
+{
+    GL_OBJECT_BUFFER = 0,
+    GL_OBJECT_VERTEX_ARRAY,
+    GL_OBJECT_TYPES
+};
+
+class GLObjectTracker
+{
+public:
+    void created(GLObjectType type, GLuint name);
+    void deleted(GLObjectType type, GLuint name);
+
+    /**
+     * Names of type alive now, and created since startup.
+     */
+    unsigned int live(GLObjectType type) const {return m_live[type];}
+    unsigned int total(GLObjectType type) const {return m_total[type];}
+
+private:
+    unsigned int m_live[GL_OBJECT_TYPES] = {};
+    unsigned int m_total[GL_OBJECT_TYPES] = {};
+
+#ifndef NDEBUG
+    std::unordered_set<GLuint> m_names[GL_OBJECT_TYPES];
+#endif
+};
+
+/**
+ * Tracker for the context current in this process.
+ */
+extern GLObjectTracker& glObjects();
+
+template<GLObjectType type>
+class GLHandle
+{
+public:
+    GLHandle() {}
+    ~GLHandle() {reset();}
+
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+
+    GLHandle(GLHandle&& other) : m_name(other.release()) {}
+    GLHandle& operator=(GLHandle&& other);
+
+    /**
+     * The name, created on first use.  Needs a current context then.
+     */
+    GLuint get() const;
+
+    /**
+     * The name if one was created, else 0.  Never calls GL.
+     */
+    GLuint id() const {return m_name;}
+    explicit operator bool() const {return m_name != 0;}
+
+    /**
+     * Delete the name, if any.  The next get() creates a new one.
+     */
+    void reset();
+
+    /**
+     * Give up ownership of the name, leaving the handle empty.  The caller
+     * must delete it, or hand it to adopt().
+     */
+    GLuint release();
+
+    /**
+     * Take ownership of a name created elsewhere, deleting the current one.
+     */
+    void adopt(GLuint name);
+
+private:
+    // Lazily created, so get() may be called on const handles.
+    mutable GLuint m_name = 0;
+};
+
+typedef GLHandle<GL_OBJECT_BUFFER> GLBuffer;
+typedef GLHandle<GL_OBJECT_VERTEX_ARRAY> GLVertexArray;
+
+/*************************************************************************
+ *
+ * GLHandle: Template definitions
+ *
+ *************************************************************************/
+
+/**
+ * Create and delete one name of type, telling glObjects() and the state
+ * cache.  Defined in globject.cpp for each GLObjectType.
+ */
+template<GLObjectType type> GLuint glObjectCreate();
+template<GLObjectType type> void glObjectDelete(GLuint name);
+
+template<> GLuint glObjectCreate<GL_OBJECT_BUFFER>();
+template<> GLuint glObjectCreate<GL_OBJECT_VERTEX_ARRAY>();
+template<> void glObjectDelete<GL_OBJECT_BUFFER>(GLuint name);
+template<> void glObjectDelete<GL_OBJECT_VERTEX_ARRAY>(GLuint name);
+
+template<GLObjectType type>
+GLHandle<type>& GLHandle<type>::operator=(GLHandle&& other)
+{
+    if (this != &other)
+        adopt(other.release());
+    return *this;
+}
+
+template<GLObjectType type>
+GLuint GLHandle<type>::get() const
+{
+    if (!m_name)
+        m_name = glObjectCreate<type>();
+    return m_name;
+}
+
+template<GLObjectType type>
+void GLHandle<type>::reset()
+{
+    if (m_name)
+        glObjectDelete<type>(m_name);
+    m_name = 0;
+}
+
+template<GLObjectType type>
+GLuint GLHandle<type>::release()
+{
+    GLuint name = m_name;
+    m_name = 0;
+    return name;
+}
+
+template<GLObjectType type>
+void GLHandle<type>::adopt(GLuint name)
+{
+    reset();
+    m_name = name;
+}
+
+#endif
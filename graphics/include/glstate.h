@@ -0,0 +1,109 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+/**********************************************************************************
+ *
+ * Shadow copy of the binding state this code changes: the current program,
+ * the vertex array, indexed uniform/storage buffer bindings and the dispatch
+ * indirect buffer.  A bind that matches the shadow is skipped, so callers can
+ * bind what they need without restoring zero afterwards.  Buffer contents
+ * and vertex array setup go through DSA calls and need no binding at all.
+ *
+ * Code that changes these bindings behind the cache's back must call
+ * invalidate() (ImGui's GL backend restores what it touches, so it is fine).
+ *
+ **********************************************************************************/
+
+#define GLSTATE_MAX_BUFFER_BINDINGS 16
+
+// Context version to ask for.  The DSA calls need 4.5, or 4.3 with
+// ARB_direct_state_access.
+#define HOPF_GL_MAJOR 4
+#define HOPF_GL_MINOR 5
+
+struct GLStateStats
+{
+    unsigned int issued = 0;    // State changes passed on to GL
+    unsigned int skipped = 0;   // Redundant ones suppressed
+};
+
+class GLStateCache
+{
+public:
+    GLStateCache() {invalidate();}
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+
+    /**
+     * Bind to an indexed GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER
+     * binding point.  Indices past GLSTATE_MAX_BUFFER_BINDINGS are not
+     * tracked and always issued.
+     */
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    /**
+     * Bind a non-indexed target.  Only GL_DISPATCH_INDIRECT_BUFFER is
+     * tracked; other targets are always issued.
+     */
+    void bindBuffer(GLenum target, GLuint buffer);
+
+    /**
+     * Forget objects about to be deleted.  GL unbinds them itself, and their
+     * names may be reused.
+     */
+    void forgetBuffer(GLuint buffer);
+    void forgetVertexArray(GLuint vao);
+    void forgetProgram(GLuint program);
+
+    /**
+     * Assume nothing about the current bindings, e.g. on a new context.
+     */
+    void invalidate();
+
+    /**
+     * Start counting a new frame.  lastFrame() then holds the one just ended.
+     */
+    void beginFrame();
+    const GLStateStats& lastFrame() const {return m_lastFrame;}
+
+private:
+    // An indexed binding; a size of 0 binds the whole buffer.
+    struct BufferBinding
+    {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+
+        bool operator==(const BufferBinding&) const = default;
+    };
+
+    BufferBinding* bindings(GLenum target, GLuint index);
+
+    // ~0u marks a binding whose GL value is unknown.
+    GLuint m_program;
+    GLuint m_vao;
+    BufferBinding m_uniformBuffers[GLSTATE_MAX_BUFFER_BINDINGS];
+    BufferBinding m_storageBuffers[GLSTATE_MAX_BUFFER_BINDINGS];
+    GLuint m_dispatchIndirectBuffer;
+
+    GLStateStats m_frame;
+    GLStateStats m_lastFrame;
+};
+
+/**
+ * Cache for the context current in this process.
+ */
+extern GLStateCache& glState();
+
+/**
+ * Whether the current context has the DSA entry points, so the first buffer
+ * created does not call through a null pointer.  Prints an error if not.
+ * Call after glewInit.
+ */
+extern bool checkGLVersion();
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef GPUARENA_H
+#define GPUARENA_H
+
+#include <GL/glew.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "globject.h"
+
+/**********************************************************************************
+ *
+ * GPU memory arena.  Ranges are suballocated from a few large immutable
+ * buffers (glNamedBufferStorage), so every scene sharing the arena draws
+ * from the same handful of GL buffers and memory use is known per
+ * subsystem rather than spread over one allocation per Buffer.
+ *
+ * Persistent ranges live until released.  Transient ranges are bump
+ * allocated from a ring of per-frame segments; a segment is reused once the
+ * GPU has finished the frame that last used it, so transients must not be
+ * kept past the frame they were allocated in.
+ *
+ **********************************************************************************/
+
+#define GPU_ARENA_BLOCK_SIZE     (32 << 20)  // Size of each persistent block
+#define GPU_ARENA_SEGMENT_SIZE   (4 << 20)   // Transient bytes per frame
+#define GPU_ARENA_FRAMES         3           // Frames a transient segment may be in flight
+
+struct GpuRange
+{
+    GLuint buffer = 0;
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+struct GpuArenaUsage
+{
+    size_t live = 0;                // Bytes allocated now
+    size_t peak = 0;                // Most bytes allocated at once
+    unsigned int allocations = 0;   // Live ranges
+};
+
+class GpuArena
+{
+public:
+    /**
+     * Blocks are only created on first use, so this needs no GL context.
+     *
+     * @param blockSize - Size of each persistent block.  Larger requests get
+     *                    a block of their own.
+     * @param segmentSize - Transient bytes available per frame.
+     */
+    GpuArena(size_t blockSize = GPU_ARENA_BLOCK_SIZE, size_t segmentSize = GPU_ARENA_SEGMENT_SIZE);
+    ~GpuArena();
+
+    GpuArena(const GpuArena&) = delete;
+    GpuArena& operator=(const GpuArena&) = delete;
+
+    /**
+     * Range of at least size bytes, aligned for use as a uniform or storage
+     * buffer range, counted against subsystem.
+     */
+    GpuRange allocate(size_t size, const std::string& subsystem);
+    void release(const GpuRange& range);
+
+    /**
+     * Range valid until the GPU finishes the current frame.  A size over
+     * the segment size gets a persistent range, released once the GPU is
+     * done with the frame.
+     */
+    GpuRange allocateTransient(size_t size, const std::string& subsystem);
+
+    /**
+     * Start a new frame.  Transient ranges of the previous one stop counting
+     * as live; their memory is reused once the GPU is done with them.
+     */
+    void beginFrame();
+
+    /**
+     * Bytes the arena should stay within, or 0 for no limit.  Going over
+     * still succeeds, with a warning.
+     */
+    void setBudget(size_t bytes) {m_budget = bytes;}
+    size_t budget() const {return m_budget;}
+
+    /**
+     * Bytes held in GL buffers, used or not.
+     */
+    size_t reserved() const;
+
+    const std::map<std::string, GpuArenaUsage>& usage() const {return m_usage;}
+
+private:
+    struct Block
+    {
+        GLBuffer buffer;
+        size_t size;
+        std::map<size_t, size_t> free;  // Offset to size of each free run
+    };
+
+    size_t alignment();
+    GLBuffer createStorage(size_t size);
+    void track(const std::string& subsystem, long long bytes);
+    void nextSegment();
+
+    size_t m_blockSize;
+    size_t m_segmentSize;
+    size_t m_alignment = 0;   // Queried on first use
+    size_t m_budget = 0;
+    bool m_overBudget = false;
+
+    std::vector<Block> m_blocks;
+    std::map<std::pair<GLuint, size_t>, std::pair<std::string, size_t>> m_allocations;
+
+    // Transient ring
+    GLBuffer m_ring;
+    unsigned int m_segment = 0;
+    size_t m_segmentUsed = 0;
+    GLsync m_segmentFences[GPU_ARENA_FRAMES] = {};
+    std::vector<GpuRange> m_segmentOversized[GPU_ARENA_FRAMES];    // Released with the segment
+    std::vector<std::pair<std::string, size_t>> m_frameTransients;
+
+    std::map<std::string, GpuArenaUsage> m_usage;
+};
+
+#endif
@@ -47,6 +47,19 @@ extern std::pair<std::vector<Vertex>,std::vector<uint>> meshFromSurface(
     vec3 (*param)(float, float), const int uCount, const int vCount, const int b1, const int b2);
 
 
+/**
+* Surface parameterizations compiled into surface_mesh.comp.  The values must
+* match the constants in the shader.
+*/
+enum SurfacePreset
+{
+    SURFACE_PLANE = 0,
+    SURFACE_CYLINDER,
+    SURFACE_SPHERE,
+    SURFACE_TORUS,
+    SURFACE_WAVE
+};
+
 class Mesh : public PrimitiveData<Vertex>
 {
 public:
@@ -61,6 +74,23 @@ public:
 
     void setShaderManager(ShaderManager* shaderManager);
     void polylineMesh(Buffer& lines, Buffer& instances, PrimitiveData<Vertex>& mesh, uint resolution = 10);
+
+    /**
+    * GPU counterpart of meshFromSurface.  Evaluates a preset parameterization
+    * on a uCount x vCount grid and writes vertices and indices directly into
+    * the mesh buffers, growing them if needed.  Always produces
+    * 6*uCount*vCount indices; cells without a quad are degenerate.
+    *
+    * @param mesh - Destination mesh.
+    * @param surface - Parameterization to evaluate.
+    * @param uCount - Number of samples in first coordinate.
+    * @param vCount - Number of samples in second coordinate.
+    * @param b1 - First betti number.
+    * @param b2 - Second betti number.
+    * @param time - Passed to the parameterization for animated surfaces.
+    */
+    void surfaceMesh(PrimitiveData<Vertex>& mesh, SurfacePreset surface, 
+        uint uCount, uint vCount, int b1, int b2, float time = 0);
 private:
     ShaderManager * shaders;
     Buffer tempData;
@@ -3,9 +3,16 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <cstddef>
+#include <ranges>
+#include <span>
+#include <string>
 #include <vector>
+#include "globject.h"
+#include "gpuarena.h"
 #include "shader.h"
 #include "camera.h"
+#include "glstate.h"
 
 
 /*************************************************************************
@@ -31,32 +38,98 @@ typedef struct
     int* counts();
 } MultiIndex;
 
+/**
+ * What an upload may do with the data it overwrites.  Invalidating lets the
+ * driver hand out fresh memory instead of waiting for pending GPU reads.
+ */
+enum BufferUploadHint
+{
+    BUFFER_UPLOAD_DEFAULT = 0,  // Keep everything else; may stall on pending reads
+    BUFFER_UPLOAD_ORPHAN,       // Discard the whole old contents first
+    BUFFER_UPLOAD_INVALIDATE    // Discard only the range being written
+};
+
 /*************************************************************************
  * 
  * Buffer: Class Defintion
  * 
  *************************************************************************/
 
+/**
+ * GPU buffer with a size (bytes in use) and a capacity (bytes allocated).
+ * Storage is only reallocated when the size passes the capacity, which then
+ * grows geometrically.  Uploads read straight from the caller's memory.
+ *
+ * A buffer may instead take its storage from a range of a GpuArena.  It
+ * then starts offset() bytes into id(), and moves to a new range, and
+ * possibly a new id(), when it grows.
+ *
+ * Buffers are move-only.  Constructing one makes no GL calls; the name is
+ * created when first needed.
+ */
 class Buffer
 {
 public:
-    Buffer();
+    Buffer() {}
     Buffer(size_t size, GLenum usage);
 
     ~Buffer();
 
-    template<typename T>
-    void uploadData(std::vector<T> data, GLenum usage = GL_STREAM_DRAW);
-    void uploadData(void * data, size_t size, GLenum usage = GL_STREAM_DRAW);
-
+    Buffer(Buffer&& other);
+    Buffer& operator=(Buffer&& other);
+
+    /**
+     * Take storage from arena from now on, counted against subsystem.  Must
+     * come before anything is allocated.
+     */
+    void setArena(GpuArena* arena, const std::string& subsystem);
+
+    /**
+     * Replace the contents with data, e.g. a std::vector or std::span.
+     */
+    template<std::ranges::contiguous_range R>
+    void uploadData(const R& data, GLenum usage = GL_STREAM_DRAW, BufferUploadHint hint = BUFFER_UPLOAD_ORPHAN);
+    void uploadData(const void * data, size_t size, GLenum usage = GL_STREAM_DRAW, BufferUploadHint hint = BUFFER_UPLOAD_ORPHAN);
+
+    /**
+     * Write data starting offset bytes into the buffer, leaving the rest as
+     * is.  The size grows to cover the range if needed.
+     */
+    template<std::ranges::contiguous_range R>
+    void uploadSubData(const R& data, size_t offset, BufferUploadHint hint = BUFFER_UPLOAD_DEFAULT);
+    void uploadSubData(const void * data, size_t offset, size_t size, BufferUploadHint hint = BUFFER_UPLOAD_DEFAULT);
+
+    /**
+     * Set the size to size bytes with undefined contents.  Only allocates if
+     * the capacity is too small.
+     */
     void reserve(size_t size,GLenum usage = GL_STREAM_DRAW);
 
+    /**
+     * Bind the buffer's storage to an indexed target, e.g.
+     * GL_SHADER_STORAGE_BUFFER.
+     */
+    void bind(GLenum target, GLuint index) const;
+
     const size_t size() const {return m_size;}
-    const GLuint id() const {return m_id;}
+    const size_t capacity() const {return m_capacity;}
+    const GLuint id() const {return m_arena ? m_range.buffer : m_storage.get();}
+    const size_t offset() const {return m_range.offset;}
 
 private:
-    GLuint m_id;
-    size_t m_size;
+    void allocate(size_t capacity, GLenum usage);
+    void grow(size_t capacity);
+    void invalidate(size_t offset, size_t size);
+    void releaseRange();
+
+    GLBuffer m_storage;     // Own name, unless in an arena
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+    GLenum m_usage = GL_STREAM_DRAW;
+
+    GpuArena* m_arena = nullptr;
+    std::string m_subsystem;
+    GpuRange m_range;       // Arena range, or just the offset of 0
 };
 
 template<typename T>
@@ -79,12 +152,18 @@ private:
  * 
  *************************************************************************/
 
+/**
+ * Vertex array with its vertex and index buffers.  Move-only, and, like
+ * Buffer, creates nothing until first used.
+ */
 template<typename vType>
 class PrimitiveData
 {
 public:
-    PrimitiveData();
-    ~PrimitiveData();
+    PrimitiveData() {}
+
+    PrimitiveData(PrimitiveData&&) = default;
+    PrimitiveData& operator=(PrimitiveData&&) = default;
 
     void uploadData(const std::vector<vType>& data, GLenum usage);
     void uploadData(const std::vector<vType>& data, const std::vector<uint>& indices, GLenum usage);
@@ -92,17 +171,32 @@ public:
     void reserveAttribs(size_t count, GLenum usage = GL_STREAM_DRAW);
     void reserveIndices(size_t count, GLenum usage = GL_STREAM_DRAW);
 
+    /**
+     * Take vertex and index storage from arena, see Buffer::setArena.  The
+     * ranges move when they grow, so set up attributes after reserving.
+     */
+    void setArena(GpuArena* arena, const std::string& subsystem);
+
     void attribPointer(GLuint location, GLint size, GLenum type, GLboolean normalized, 
     const void* pointer, GLuint buffer = -1);
     void attribIPointer(GLuint location, GLint size, GLenum type, const void* pointer);
     void attribLPointer(GLuint location, GLint size, GLenum type, const void* pointer);
 
+    /**
+     * Make this the current vertex array.  It is left bound; the state
+     * cache skips rebinding it for the next draw.
+     */
     void bindArray() const; 
-    void unbindArray() const;
 
     size_t attribCount() {return m_vbo.size()/sizeof(vType);}
     size_t indexCount() {return m_ebo.size()/sizeof(uint);}
 
+    /**
+     * Where the indices start in the element buffer, to pass as the indices
+     * argument of glDrawElements.
+     */
+    const void* indexOffset() const {return (const void*)m_ebo.offset();}
+
     MultiIndex* getMultiDrawIndices();
     void setMultiDrawIndices(const MultiIndex& indices);
     void setMultiDrawIndices(MultiIndex&& indices);
@@ -111,7 +205,7 @@ public:
     Buffer * ebo(){return &m_ebo;}
 
 private:
-    GLuint m_vao;
+    GLVertexArray m_vao;
     Buffer m_vbo;
     Buffer m_ebo;
 
@@ -139,31 +233,25 @@ protected:
  * Buffer: Template defintions
  * 
  *************************************************************************/
-template <typename T>
-inline void Buffer::uploadData(std::vector<T> data, GLenum usage)
+template<std::ranges::contiguous_range R>
+inline void Buffer::uploadData(const R& data, GLenum usage, BufferUploadHint hint)
+{
+    auto bytes = std::as_bytes(std::span(data));
+    uploadData(bytes.data(), bytes.size(), usage, hint);
+}
+
+template<std::ranges::contiguous_range R>
+inline void Buffer::uploadSubData(const R& data, size_t offset, BufferUploadHint hint)
 {
-    if (!m_id) glGenBuffers(1,&m_id);
-    
-    size_t size = data.size()*sizeof(T);
-    glBindBuffer(GL_ARRAY_BUFFER,m_id);
-
-    if (size < m_size)
-    {
-        glBufferSubData(GL_ARRAY_BUFFER,0,size,data.data());   
-    } 
-    else 
-    {
-        glBufferData(GL_ARRAY_BUFFER,size,data.data(),usage);  
-    }
-    m_size = size;
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+    auto bytes = std::as_bytes(std::span(data));
+    uploadSubData(bytes.data(), offset, bytes.size(), hint);
 }
 
 template<typename T>
 BufferMap<T>::BufferMap(Buffer& buffer, size_t offset, size_t length, GLbitfield access)
 {
     m_id = buffer.id();
-    data = (T*)glMapNamedBufferRange(m_id,offset*sizeof(T),length*sizeof(T),access);
+    data = (T*)glMapNamedBufferRange(m_id,buffer.offset() + offset*sizeof(T),length*sizeof(T),access);
 };
 
 template<typename T>
@@ -191,60 +279,47 @@ void BufferMap<T>::unmap()
  * 
  *************************************************************************/
 
-template<typename vType>
-PrimitiveData<vType>::PrimitiveData()
-{
-    glGenVertexArrays(1,&m_vao);
-}
-
-template<typename vType>
-PrimitiveData<vType>::~PrimitiveData()
-{
-    glDeleteVertexArrays(1,&m_vao);
-}
-
 template<typename vType>
 void PrimitiveData<vType>::uploadData(const std::vector<vType>& data, const std::vector<uint>& indices, GLenum usage)
 {
-    m_vbo.uploadData((void*)data.data(),data.size()*sizeof(vType),usage);
-    m_ebo.uploadData((void*)indices.data(),indices.size()*sizeof(uint),usage);
+    m_vbo.uploadData(data,usage);
+    m_ebo.uploadData(indices,usage);
 
-    glBindVertexArray(m_vao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ebo.id());
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+    glVertexArrayElementBuffer(m_vao.get(),m_ebo.id());
 }
 
 template<typename vType>
 void PrimitiveData<vType>::reserveAttribs(size_t count, GLenum usage)
 {
-    glBindVertexArray(m_vao);
     m_vbo.reserve(count*sizeof(vType),usage);
-    glBindVertexArray(0);
 }
 
 template<typename vType>
 void PrimitiveData<vType>::reserveIndices(size_t count, GLenum usage)
 {
-    glBindVertexArray(m_vao);
     m_ebo.reserve(count*sizeof(uint),usage);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ebo.id());
-    glBindVertexArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+    glVertexArrayElementBuffer(m_vao.get(),m_ebo.id());
 }
 
 template <typename vType>
-void PrimitiveData<vType>::bindArray() const
+void PrimitiveData<vType>::setArena(GpuArena* arena, const std::string& subsystem)
 {
-    glBindVertexArray(m_vao);
+    m_vbo.setArena(arena,subsystem);
+    m_ebo.setArena(arena,subsystem);
 }
 
 template <typename vType>
-void PrimitiveData<vType>::unbindArray() const
+void PrimitiveData<vType>::bindArray() const
 {
-    glBindVertexArray(0);
+    glState().bindVertexArray(m_vao.get());
 }
 
+/**
+ * Attributes are set up with DSA calls: each location gets its own vertex
+ * buffer binding, whose offset is the attribute's byte offset, which is what
+ * glVertexAttribPointer would record, plus where the VBO starts in its
+ * arena block.
+ */
 template <typename vType>
 void PrimitiveData<vType>::attribPointer(
         GLuint         location,   // Location of attribute in vertex array  
@@ -255,14 +330,14 @@ void PrimitiveData<vType>::attribPointer(
         GLuint         buffer
     )
 {
-    glBindVertexArray(m_vao);
     // if buffer was not specified, use the primitive data
-    glBindBuffer(GL_ARRAY_BUFFER,buffer == -1 ? m_vbo.id() : buffer);
-    glEnableVertexAttribArray(location);
-    glVertexAttribPointer(location,size,type,normalized,sizeof(vType),pointer);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+    if (buffer == -1)
+        glVertexArrayVertexBuffer(m_vao.get(),location,m_vbo.id(),m_vbo.offset() + (GLintptr)pointer,sizeof(vType));
+    else
+        glVertexArrayVertexBuffer(m_vao.get(),location,buffer,(GLintptr)pointer,sizeof(vType));
+    glVertexArrayAttribFormat(m_vao.get(),location,size,type,normalized,0);
+    glVertexArrayAttribBinding(m_vao.get(),location,location);
+    glEnableVertexArrayAttrib(m_vao.get(),location);
 }
 
 template <typename vType>
@@ -273,13 +348,10 @@ void PrimitiveData<vType>::attribIPointer(
         const void*    pointer     // Byte offset from beginning of VBO to first occurence of this attribute.
     )
 {
-    glBindVertexArray(m_vao);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo.id());
-    glEnableVertexAttribArray(location);
-    glVertexAttribIPointer(location,size,type,sizeof(vType),pointer);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+    glVertexArrayVertexBuffer(m_vao.get(),location,m_vbo.id(),m_vbo.offset() + (GLintptr)pointer,sizeof(vType));
+    glVertexArrayAttribIFormat(m_vao.get(),location,size,type,0);
+    glVertexArrayAttribBinding(m_vao.get(),location,location);
+    glEnableVertexArrayAttrib(m_vao.get(),location);
 }
 
 template <typename vType>
@@ -290,13 +362,10 @@ void PrimitiveData<vType>::attribLPointer(
         const void*    pointer     // Byte offset from beginning of VBO to first occurence of this attribute.
     )
 {
-    glBindVertexArray(m_vao);
-    glBindBuffer(GL_ARRAY_BUFFER,m_vbo.id());
-    glEnableVertexAttribArray(location);
-    glVertexAttribLPointer(location,size,type,sizeof(vType),pointer);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+    glVertexArrayVertexBuffer(m_vao.get(),location,m_vbo.id(),m_vbo.offset() + (GLintptr)pointer,sizeof(vType));
+    glVertexArrayAttribLFormat(m_vao.get(),location,size,type,0);
+    glVertexArrayAttribBinding(m_vao.get(),location,location);
+    glEnableVertexArrayAttrib(m_vao.get(),location);
 }
 
 template <typename vType>
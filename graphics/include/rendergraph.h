@@ -0,0 +1,225 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <string>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "gpuarena.h"
+#include "renderer.h"
+
+/**********************************************************************************
+ *
+ * Pass graph for GPU work on buffers.  Each pass declares the buffers it
+ * touches and how; nothing runs until execute(), which then
+ *
+ *   - culls passes whose writes nobody reads and that write no output,
+ *   - places transient buffers in per-frame GpuArena ranges, sharing one
+ *     range between transients whose lifetimes do not overlap,
+ *   - issues, before each pass, one glMemoryBarrier with only the bits its
+ *     accesses need after earlier shader writes.
+ *
+ * Shader writes are incoherent, so the barrier has to come before the
+ * consumer and depends on how it reads.  Which writes are still pending is
+ * tracked per buffer range in BufferHazards, and an access waits on every
+ * range it overlaps, which outlives any one graph:
+ * the last barrier for a graph's outputs is only issued once something
+ * uses them.  Code reading those outputs outside a graph, e.g. draws, must
+ * call bufferHazards().prepare() first.
+ *
+ **********************************************************************************/
+
+/**
+ * Ways a pass or draw may access a buffer.  Combine with |.
+ */
+enum BufferUsage : uint
+{
+    USAGE_STORAGE_READ  = 1 << 0,   // Shader storage block reads
+    USAGE_STORAGE_WRITE = 1 << 1,   // Shader storage block writes
+    USAGE_VERTEX        = 1 << 2,   // Vertex attribute fetch
+    USAGE_INDEX         = 1 << 3,   // Element array
+    USAGE_INDIRECT      = 1 << 4,   // Indirect draw or dispatch commands
+    USAGE_UNIFORM       = 1 << 5,   // Uniform block reads
+    USAGE_UPDATE        = 1 << 6    // glBufferSubData, copies and clears
+};
+
+// Usages that change the contents.
+#define USAGE_WRITES (USAGE_STORAGE_WRITE | USAGE_UPDATE)
+
+struct BufferAccess
+{
+    GLuint buffer;
+    uint usage;
+    size_t offset = 0;  // Start of the range in buffer, for arena ranges
+    size_t size = 0;    // Bytes in the range, or 0 for the rest of buffer
+};
+
+/**
+ * Access to the whole range of buffer.
+ */
+extern BufferAccess bufferAccess(const Buffer& buffer, uint usage);
+
+class BufferHazards
+{
+public:
+    /**
+     * Barrier bits needed before access, given the writes recorded so far.
+     */
+    GLbitfield required(const BufferAccess& access) const;
+
+    /**
+     * Issue one barrier covering every access, then record the accesses as
+     * made.  Returns false if no barrier was needed.
+     */
+    bool prepare(const std::vector<BufferAccess>& accesses);
+
+    /**
+     * Record an issued glMemoryBarrier.
+     */
+    void barrier(GLbitfield bits);
+
+    /**
+     * Record an access once its command has been issued.
+     */
+    void accessed(const BufferAccess& access);
+
+    /**
+     * Record that the commands issued so far on access's range have
+     * completed, e.g. once glWaitSync returns on a fence placed after them.
+     * Shader writes then no longer need a barrier to follow their reads.
+     */
+    void retired(const BufferAccess& access);
+
+    /**
+     * Forget everything, e.g. on a new context.
+     */
+    void invalidate() {m_buffers.clear();}
+
+private:
+    struct State
+    {
+        size_t end = 0;             // End of the range starting at the key's offset
+        GLbitfield unflushed = 0;   // Barrier bits not issued since the last shader write
+        bool storageRead = false;   // Read by a shader since the last storage barrier
+    };
+
+    std::map<std::pair<GLuint, size_t>, State> m_buffers;
+};
+
+/**
+ * Tracker for the context current in this process.
+ */
+extern BufferHazards& bufferHazards();
+
+typedef uint RGResource;
+
+struct PassAccess
+{
+    RGResource resource;
+    uint usage;
+};
+
+struct RenderGraphStats
+{
+    unsigned int passes = 0;        // Passes run
+    unsigned int culled = 0;        // Passes dropped as unused
+    unsigned int barriers = 0;      // glMemoryBarrier calls
+    size_t transientBytes = 0;      // Arena bytes backing the transients
+};
+
+class RenderGraph
+{
+public:
+    /**
+     * @param arena - Where transients are allocated, per frame.  Only graphs
+     *                with transients need one.
+     * @param subsystem - Name the transients are counted under in arena.
+     */
+    RenderGraph(GpuArena* arena = nullptr, const std::string& subsystem = "transient");
+
+    /**
+     * Buffer owned elsewhere, whose contents outlive the graph.
+     */
+    RGResource import(const std::string& name, const Buffer& buffer);
+
+    /**
+     * Scratch buffer of size bytes, only valid between its first and last
+     * use in this graph.  Its contents are undefined on first use.
+     */
+    RGResource transient(const std::string& name, size_t size);
+
+    /**
+     * Keep the passes writing resource, since it is used after execute().
+     */
+    void output(RGResource resource);
+
+    /**
+     * Add a pass.  run is called from execute() if the pass survives culling,
+     * after the barriers its accesses need.  Passes run in the order added.
+     * A pass that writes nothing is never culled.
+     */
+    void addPass(
+        const std::string& name,
+        std::vector<PassAccess> accesses,
+        std::function<void(RenderGraph&)> run);
+
+    /**
+     * GL name and range behind resource.  Transients only have them inside
+     * run.
+     */
+    GLuint buffer(RGResource resource) const;
+    size_t offset(RGResource resource) const;
+
+    /**
+     * Bind resource's range to an indexed target.
+     */
+    void bind(GLenum target, GLuint index, RGResource resource) const;
+
+    /**
+     * Write size bytes of data to the start of resource.
+     */
+    void upload(RGResource resource, const void* data, size_t size) const;
+
+    /**
+     * Compile and run the passes, then clear them and the resources.  If the
+     * transients cannot be placed no pass runs, and false is returned.
+     */
+    bool execute();
+
+    const RenderGraphStats& lastStats() const {return m_stats;}
+
+private:
+    struct Resource
+    {
+        std::string name;
+        GLuint buffer = 0;
+        size_t offset = 0;
+        size_t size = 0;
+        bool transient = false;
+        bool output = false;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<PassAccess> accesses;
+        std::function<void(RenderGraph&)> run;
+        bool live = false;
+    };
+
+    void cull();
+    bool placeTransients();
+
+    GpuArena* m_arena;
+    std::string m_subsystem;
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    RenderGraphStats m_stats;
+};
+
+#endif
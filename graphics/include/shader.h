@@ -4,20 +4,28 @@
 
 #include <GL/glew.h> 
 #include <GLFW/glfw3.h> 
+#include <map>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include "defines.h"
+#include "glstate.h"
 
 struct ShaderProgram 
 {
 	GLuint id;
 
-	void use() {glUseProgram(id);}
+	void use() {glState().useProgram(id);}
+
+	/**
+	 * False for a variant that failed to compile or link.
+	 */
+	bool valid() const {return id != 0;}
 
 	void setUniform(const char* name, int value);
 	void setUniform(const char* name, unsigned int value);
 	void setUniform(const char* name, float value);
+	void setUniform(const char* name, vec2 value);
 	void setUniform(const char* name, vec3 value);
 	void setUniform(const char* name, mat3 value, GLboolean transpose);
 	void setUniform(const char* name, mat4 value, GLboolean transpose);
@@ -25,10 +33,33 @@ struct ShaderProgram
 	GLint getUniform(const char* name) const { return glGetUniformLocation(id, name); }
 
 	void dispatchCompute(const uint countX, const uint countY, const uint countZ);
+
+	/**
+	 * Dispatch with the group counts stored at offset in buffer, laid out as
+	 * three consecutive uints (x, y, z).
+	 */
+	void dispatchComputeIndirect(GLuint buffer, GLintptr offset);
+
+	/**
+	 * Local work group size declared by the compute shader, or 1x1x1 for
+	 * an invalid program, whose dispatches do nothing.
+	 */
+	void workGroupSize(GLint sizes[3]) const;
 };
 
+/**
+ * Macros injected into a shader variant, e.g. {"LINE_DETAIL", "8"}.  Ordered,
+ * so equal sets always produce the same variant key.
+ */
+typedef std::map<std::string, std::string> ShaderDefines;
+
 /**
  * Stores a record of compiled shaders and linked programs. 
+ *
+ * Sources may #include "file.glsl" relative to their own directory; each file
+ * is pasted in at most once.  Variants of a program are compiled on demand
+ * with extra #defines placed after the #version line, so kernels can be
+ * specialised with compile-time local sizes, detail levels and toggles.
  */
 class ShaderManager
 {
@@ -47,11 +78,27 @@ public:
 	bool addProgram(const std::string& name, const std::vector<std::string>& shaders);
 
 	ShaderProgram& program(const std::string& name);
+
+	/**
+	 * Program name with every shader recompiled with defines.  Built on first
+	 * use and cached per variant key; an empty set is the program itself.
+	 * A variant that fails to build is reported once and returned invalid.
+	 */
+	ShaderProgram& program(const std::string& name, const ShaderDefines& defines);
 private:
+	struct ShaderSource
+	{
+		GLenum type;
+		std::string text;	// Includes already expanded
+	};
+
 	GLuint compileShader(GLenum type, const char* source);
+	GLuint linkProgram(const std::vector<GLuint>& shaders);
 
 	std::unordered_map<std::string, GLuint> m_shaders;
+	std::unordered_map<std::string, ShaderSource> m_sources;
 	std::unordered_map<std::string, ShaderProgram> m_programs;
+	std::unordered_map<std::string, std::vector<std::string>> m_programShaders;
 };
 
 
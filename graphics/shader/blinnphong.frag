@@ -15,13 +15,16 @@ layout (std140,binding = 0) uniform Camera {
 	float far;
 };
 
+uniform bool twoSided;      // Light back faces as if they were front faces
+
 float PI = 3.141592654;
 
 vec4 calc_light(vec3 light, vec4 color) {
     vec3 light_ray = normalize(light - fpos);
     vec3 view_dir = normalize(vec3(cam_pos)-fpos);
-    float diffuse = max(dot(fnormal,light_ray),0.0f);
-    vec3 reflect_dir = reflect(-light_ray,fnormal);
+    vec3 normal = twoSided && dot(fnormal,view_dir) < 0 ? -fnormal : fnormal;
+    float diffuse = max(dot(normal,light_ray),0.0f);
+    vec3 reflect_dir = reflect(-light_ray,normal);
     float spec = pow(max(dot(view_dir,reflect_dir),0.0f),32);
 
     return (diffuse + 0.2) * color + spec*vec4(1);
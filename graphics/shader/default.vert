@@ -14,6 +14,8 @@ layout (std140,binding = 0) uniform Camera {
 uniform mat4 model;
 uniform float scale;
 
+#include "fiber_motion.glsl"
+
 layout (location = 0) in vec4 v_pos;
 layout (location = 1) in vec4 v_color;
 layout (location = 2) in vec4 v_normal;
@@ -26,8 +28,9 @@ void main() {
 	float nscale = v_normal.w == 0 ? 1 : v_normal.w;
 
 	// Apply geometry transformation
-	vec4 position = model*vec4(scale*v_pos.xyz,1);
-	vec4 normal = model*vec4(normalize(v_normal.xyz/nscale),0);
+	vec3 pos = scale*v_pos.xyz;
+	vec4 position = model*vec4(motion_point(pos),1);
+	vec4 normal = model*vec4(normalize(motion_vector(pos,v_normal.xyz/nscale)),0);
 
 	fcolor = v_color;
 	fpos = vec3(position);
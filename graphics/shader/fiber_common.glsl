@@ -0,0 +1,106 @@
+// Declarations shared by the fiber compute passes.  Pulled in with
+// #include "fiber_common.glsl" by ShaderManager; never compiled on its own.
+
+const float PI = 3.141592654;
+
+struct SpherePointData
+{
+    vec4 position;
+    vec4 color;
+};
+
+struct DrawArraysIndirectCommand
+{
+    uint  count;
+    uint  instanceCount;
+    uint  first;
+    uint  baseInstance;
+};
+
+// Matches InstanceLine in mesh.h.
+struct InstanceData
+{
+    DrawArraysIndirectCommand cmd;
+    float width;
+    float avgLength;
+};
+
+// Matches Vertex in mesh.h.
+struct VertexData
+{
+    vec4 position;
+    vec4 color;
+    vec4 normal;
+};
+
+// Matches TangentFrame in mesh.h.
+struct FrameData
+{
+    vec4 T;  // Tangent
+    vec4 N;  // Normal
+    vec4 B;  // Binormal
+};
+
+uniform bool u_useFiberList;
+
+// Compacted list of fibers to update, written by fiber_compact.comp.  Only
+// read when u_useFiberList is set; the z id then indexes the list.
+layout (std430, binding = 7) readonly buffer FiberList
+{
+    uint dispatchPerSample[3];
+    uint dispatchPerLine[3];
+    uint dispatchPerTube[3];
+    uint fiberCount;
+    uint fiberList[];
+};
+
+// Fiber handled by the invocation with z id z.  Returns false past the end.
+bool fiberIndex(uint z, uint count, out uint fiber)
+{
+    if (u_useFiberList)
+    {
+        fiber = z < fiberCount ? fiberList[z] : 0;
+        return z < fiberCount;
+    }
+    fiber = z;
+    return z < count;
+}
+
+/**
+* Closed-form projected fiber over p, evaluated at angle t.  Matches
+* fiberCircle in fiber.h: with (a,b,c) = (p.z,p.y,p.x) the fiber is the circle
+* with center (-c,-b,0)/(1+a), radius sqrt(2/(1+a)) and normal
+* (-b,c,1+a)/sqrt(2(1+a)).  The fiber through the projection pole is a line,
+* so 1+a is clamped to keep its neighbours finite.
+*/
+vec3 hopf_circle(vec3 p, float t)
+{
+    float a = p.z;
+    float b = p.y;
+    float c = p.x;
+
+    float rho2 = b*b + c*c;
+    float onePlusA = a >= 0 ? 1 + a : rho2/(1 - a);
+    onePlusA = max(onePlusA, 1e-6);
+
+    vec3 center = vec3(-c,-b,0)/onePlusA;
+    float radius = sqrt(2/onePlusA);
+    vec3 normal = vec3(-b,c,onePlusA)/sqrt(2*onePlusA);
+    vec3 axis = rho2 > 0 ? vec3(c,b,0)*inversesqrt(rho2) : vec3(1,0,0);
+    vec3 binormal = cross(normal,axis);
+
+    return center + radius*(cos(t)*axis + sin(t)*binormal);
+}
+
+// Intersection of a line and a plane, or the origin if they are parallel.
+vec3 linePlaneIntersect(vec3 linePoint, vec3 lineDir, vec3 planePoint, vec3 planeNormal)
+{
+    float denom = dot(planeNormal, lineDir);
+
+    if (abs(denom) < 1e-6)
+        return vec3(0, 0, 0);
+
+    float t = dot(planePoint - linePoint, planeNormal) / denom;
+
+    return linePoint + t * lineDir;
+}
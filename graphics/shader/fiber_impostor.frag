@@ -0,0 +1,102 @@
+#version 430 core
+
+// Ray-cast capsule for one fiber segment, see fiber_impostor.vert.  Shaded
+// like blinnphong.frag, as the tube mesh is.
+
+layout (std140,binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+	mat4 pv;
+	vec4 cam_pos;
+	vec4 cam_dir;
+	float near;
+	float far;
+};
+
+uniform vec3 eye;           // Centre of projection, in world space
+
+flat in vec3 segA;
+flat in vec3 segB;
+flat in float segRadius;
+flat in vec4 colorA;
+flat in vec4 colorB;
+in vec3 fpos;
+
+// The quad is drawn at the capsule's nearest depth, which lets the depth
+// test still run before the shader.
+layout (depth_greater) out float gl_FragDepth;
+
+out vec4 FragColor;
+
+vec4 calc_light(vec3 light, vec3 pos, vec3 normal, vec4 color) {
+    vec3 light_ray = normalize(light - pos);
+    vec3 view_dir = normalize(vec3(cam_pos)-pos);
+    float diffuse = max(dot(normal,light_ray),0.0f);
+    vec3 reflect_dir = reflect(-light_ray,normal);
+    float spec = pow(max(dot(view_dir,reflect_dir),0.0f),32);
+
+    return (diffuse + 0.2) * color + spec*vec4(1);
+}
+
+// Distance along rd (normalized) to the first hit with the capsule from pa
+// to pb, or -1 if the ray misses.
+float capsuleIntersect(vec3 ro, vec3 rd, vec3 pa, vec3 pb, float r)
+{
+    vec3 ba = pb - pa;
+    vec3 oa = ro - pa;
+
+    float baba = dot(ba,ba);
+    float bard = dot(ba,rd);
+    float baoa = dot(ba,oa);
+    float rdoa = dot(rd,oa);
+    float oaoa = dot(oa,oa);
+
+    // Cylinder
+    float a = baba - bard*bard;
+    float b = baba*rdoa - baoa*bard;
+    float c = baba*oaoa - baoa*baoa - r*r*baba;
+    float h = b*b - a*c;
+
+    if (h >= 0.0)
+    {
+        float t = (-b - sqrt(h))/a;
+        float y = baoa + t*bard;
+
+        if (y > 0.0 && y < baba)
+            return t;
+
+        // Cap at the end the ray reaches first
+        vec3 oc = (y <= 0.0) ? oa : ro - pb;
+        b = dot(rd,oc);
+        c = dot(oc,oc) - r*r;
+        h = b*b - c;
+
+        if (h > 0.0)
+            return -b - sqrt(h);
+    }
+
+    return -1.0;
+}
+
+void main()
+{
+    vec3 rd = normalize(fpos - eye);
+    float t = capsuleIntersect(eye, rd, segA, segB, segRadius);
+
+    if (t < 0.0)
+        discard;
+
+    vec3 hit = eye + t*rd;
+    vec4 clip = pv*vec4(hit,1);
+
+    gl_FragDepth = 0.5*(clip.z/clip.w) + 0.5;
+
+    // Colour varies along the axis like it does over the tube mesh.  The
+    // normal points away from the nearest point on the axis, which also
+    // covers the caps.
+    vec3 ba = segB - segA;
+    float s = clamp(dot(hit - segA, ba)/max(dot(ba,ba), 1e-12), 0.0, 1.0);
+    vec3 normal = (hit - (segA + s*ba))/segRadius;
+
+    FragColor = calc_light(cam_pos.xyz, hit, normal, mix(colorA, colorB, s));
+}
@@ -0,0 +1,145 @@
+#version 430 core
+
+// Fiber tubes as ray-cast capsules, one per segment between consecutive
+// fiber samples.  Draw 6 vertices per segment with no vertex buffers: each
+// segment becomes a screen-aligned quad covering its capsule, and
+// fiber_impostor.frag intersects the capsule exactly.
+
+#include "fiber_common.glsl"
+#include "fiber_motion.glsl"
+
+layout (std140,binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+	mat4 pv;
+	vec4 cam_pos;
+	vec4 cam_dir;
+	float near;
+	float far;
+};
+
+// Fiber samples, as written by hopf.comp or fiber_fused.comp.
+layout (std430, binding = 0) readonly buffer FiberSamples
+{
+    VertexData samples[];
+};
+
+layout (std430, binding = 1) readonly buffer instanceData
+{
+    InstanceData instance[];
+};
+
+uniform uint fiberSize;     // Sample slots per fiber
+uniform mat4 invPV;         // inverse(pv)
+
+flat out vec3 segA;
+flat out vec3 segB;
+flat out float segRadius;
+flat out vec4 colorA;
+flat out vec4 colorB;
+out vec3 fpos;              // Point on the quad, in world space
+
+const vec2 quadCorners[6] = vec2[](
+    vec2(0,0), vec2(1,0), vec2(1,1),
+    vec2(0,0), vec2(1,1), vec2(0,1));
+
+void main()
+{
+    uint segment = uint(gl_VertexID)/6;
+    uint fiber = segment/fiberSize;
+    uint sample_ = segment % fiberSize;
+
+    uint count = instance[fiber].cmd.count;
+    uint first = instance[fiber].cmd.first;
+
+    // Slots past the fiber's samples draw nothing.
+    if (sample_ >= count)
+    {
+        gl_Position = vec4(0,0,0,1);
+        return;
+    }
+
+    // Fibers are closed, like the tube mesh.
+    VertexData a = samples[first + sample_];
+    VertexData b = samples[first + (sample_ + 1) % count];
+    float r = instance[fiber].width;
+
+    // Moved fibers keep their tube radius, unlike moved tube meshes.
+    segA = motion_point(a.position.xyz);
+    segB = motion_point(b.position.xyz);
+    segRadius = r;
+    colorA = a.color;
+    colorB = b.color;
+
+    // Box around the capsule, oriented along its axis.
+    vec3 axis = segB - segA;
+    float len = length(axis);
+    vec3 u = len > 1e-6 ? axis/len : vec3(1,0,0);
+    vec3 v = normalize(cross(u, abs(u.x) < 0.9 ? vec3(1,0,0) : vec3(0,1,0)));
+    vec3 w = cross(u, v);
+
+    vec4 clip[8];
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = ((i & 1) != 0 ? segB + r*u : segA - r*u)
+                    + ((i & 2) != 0 ? r : -r)*v
+                    + ((i & 4) != 0 ? r : -r)*w;
+
+        clip[i] = pv*vec4(corner,1);
+    }
+
+    // Bounds of the box clipped to the near plane (z = -w): the corners in
+    // front of it, and where the box edges cross it.
+    vec3 lo = vec3(1e30);
+    vec3 hi = vec3(-1e30);
+    bool visible = false;
+
+    for (int i = 0; i < 8; i++)
+    {
+        float di = clip[i].z + clip[i].w;
+
+        if (di >= 0.0)
+        {
+            vec3 ndc = clip[i].xyz/clip[i].w;
+            lo = min(lo, ndc);
+            hi = max(hi, ndc);
+            visible = true;
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            int j = i | (1 << k);
+            if (j == i)
+                continue;
+
+            float dj = clip[j].z + clip[j].w;
+            if ((di >= 0.0) == (dj >= 0.0))
+                continue;
+
+            vec4 cross_ = mix(clip[i], clip[j], di/(di - dj));
+            vec3 ndc = cross_.xyz/cross_.w;
+            lo = min(lo, ndc);
+            hi = max(hi, ndc);
+        }
+    }
+
+    // The whole capsule is behind the near plane.
+    if (!visible)
+    {
+        gl_Position = vec4(0,0,0,1);
+        return;
+    }
+
+    lo = clamp(lo, -1.0, 1.0);
+    hi = clamp(hi, -1.0, 1.0);
+
+    // The quad sits at the capsule's nearest depth, so the depth written by
+    // the fragment shader is never in front of it (see depth_greater).
+    vec2 corner = mix(lo.xy, hi.xy, quadCorners[gl_VertexID % 6]);
+    vec4 ndc = vec4(corner, lo.z, 1);
+
+    vec4 world = invPV*ndc;
+    fpos = world.xyz/world.w;
+
+    gl_Position = ndc;
+}
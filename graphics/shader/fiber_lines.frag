@@ -0,0 +1,26 @@
+#version 430 core
+
+// Coverage of a constant width line, see fiber_lines.vert.
+
+uniform float lineWidth;    // In render target pixels
+uniform float lineAlpha;    // Opacity of a line one pixel or more wide
+
+in vec4 fcolor;
+noperspective in float edge;
+
+out vec4 FragColor;
+
+void main()
+{
+    // Box filtered coverage of the pixel by the line: 1 inside, falling off
+    // linearly over the pixel that straddles the edge.
+    float halfWidth = 0.5*max(lineWidth, 1.0);
+    float coverage = clamp(halfWidth + 0.5 - abs(edge), 0.0, 1.0);
+
+    coverage *= min(lineWidth, 1.0)*lineAlpha;
+
+    if (coverage <= 0.0)
+        discard;
+
+    FragColor = vec4(fcolor.rgb, fcolor.a*coverage);
+}
@@ -0,0 +1,101 @@
+#version 430 core
+
+// Fibers as anti-aliased lines of constant screen width, straight from the
+// circle samples.  Draw 6 vertices per segment with no vertex buffers: each
+// segment between consecutive samples is expanded into a quad across its
+// projected direction, with a one pixel fringe that fiber_lines.frag fades
+// out.
+
+#include "fiber_common.glsl"
+#include "fiber_motion.glsl"
+
+layout (std140,binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+	mat4 pv;
+	vec4 cam_pos;
+	vec4 cam_dir;
+	float near;
+	float far;
+};
+
+// Fiber samples, as written by hopf.comp or fiber_fused.comp.
+layout (std430, binding = 0) readonly buffer FiberSamples
+{
+    VertexData samples[];
+};
+
+layout (std430, binding = 1) readonly buffer instanceData
+{
+    InstanceData instance[];
+};
+
+uniform uint fiberSize;     // Sample slots per fiber
+uniform vec2 viewport;      // Render target size in pixels
+uniform float lineWidth;    // In render target pixels
+
+out vec4 fcolor;
+noperspective out float edge;   // Pixels from the centre line
+
+const vec2 quadCorners[6] = vec2[](
+    vec2(0,-1), vec2(1,-1), vec2(1,1),
+    vec2(0,-1), vec2(1,1), vec2(0,1));
+
+void main()
+{
+    uint segment = uint(gl_VertexID)/6;
+    uint fiber = segment/fiberSize;
+    uint sample_ = segment % fiberSize;
+
+    uint count = instance[fiber].cmd.count;
+    uint first = instance[fiber].cmd.first;
+
+    // Slots past the fiber's samples draw nothing.
+    if (sample_ >= count)
+    {
+        gl_Position = vec4(0,0,0,1);
+        return;
+    }
+
+    // Fibers are closed, like the tube mesh.
+    VertexData a = samples[first + sample_];
+    VertexData b = samples[first + (sample_ + 1) % count];
+
+    vec4 ca = pv*vec4(motion_point(a.position.xyz),1);
+    vec4 cb = pv*vec4(motion_point(b.position.xyz),1);
+
+    // Clip the segment to the half space in front of the eye, where the
+    // screen projection is defined.
+    const float minW = 1e-5;
+
+    if (ca.w < minW && cb.w < minW)
+    {
+        gl_Position = vec4(0,0,0,1);
+        return;
+    }
+    if (ca.w < minW)
+        ca = mix(ca, cb, (minW - ca.w)/(cb.w - ca.w));
+    if (cb.w < minW)
+        cb = mix(cb, ca, (minW - cb.w)/(ca.w - cb.w));
+
+    vec2 sa = (0.5*ca.xy/ca.w + 0.5)*viewport;
+    vec2 sb = (0.5*cb.xy/cb.w + 0.5)*viewport;
+
+    vec2 dir = sb - sa;
+    float len = length(dir);
+    dir = len > 1e-4 ? dir/len : vec2(1,0);
+    vec2 across = vec2(-dir.y, dir.x);
+
+    // Lines thinner than a pixel are drawn a pixel wide and fainter instead.
+    float extent = 0.5*max(lineWidth, 1.0) + 1.0;
+
+    vec2 corner = quadCorners[gl_VertexID % 6];
+    vec4 clip = corner.x == 0 ? ca : cb;
+    vec2 pixel = (corner.x == 0 ? sa : sb) + corner.y*extent*across;
+
+    fcolor = corner.x == 0 ? a.color : b.color;
+    edge = corner.y*extent;
+
+    // Keep w, so depth is interpolated as for any other geometry.
+    gl_Position = vec4((2*pixel/viewport - 1)*clip.w, clip.z, clip.w);
+}
@@ -0,0 +1,40 @@
+// Isometry of S3 applied to projected fibers as they are drawn, see
+// fiberMotion in fiber.h.  Conjugated by stereographic projection it is a
+// Mobius transformation of R3, which maps circles to circles, so fibers
+// generated once follow a rotation of their base points exactly.  Pulled in
+// with #include "fiber_motion.glsl" by ShaderManager.
+
+uniform bool u_useMotion;   // Otherwise points are drawn where they are
+uniform mat4 u_motion;      // Acts on the points of S3 that project to R3
+
+// Keeps the image of the projection pole finite.
+const float MOTION_MIN_DENOM = 1e-6;
+
+vec3 motion_point(vec3 p)
+{
+    if (!u_useMotion)
+        return p;
+
+    float s = dot(p,p);
+    vec4 q = u_motion*(vec4(2*p, s - 1)/(s + 1));
+
+    return q.xyz/max(1 - q.w, MOTION_MIN_DENOM);
+}
+
+// Image of the vector v at p.  The map is conformal, so it takes normals to
+// normals, and tangents to tangents.
+vec3 motion_vector(vec3 p, vec3 v)
+{
+    if (!u_useMotion)
+        return v;
+
+    float s = dot(p,p);
+    float pv = dot(p,v);
+
+    // Derivatives of inverse stereographic projection and of projection
+    vec4 q = u_motion*(vec4(2*p, s - 1)/(s + 1));
+    vec4 dq = u_motion*((vec4(2*v, 2*pv)*(s + 1) - vec4(2*p, s - 1)*2*pv)/((s + 1)*(s + 1)));
+    float denom = max(1 - q.w, MOTION_MIN_DENOM);
+
+    return dq.xyz/denom + q.xyz*dq.w/(denom*denom);
+}
@@ -0,0 +1,58 @@
+#version 430 core
+
+// Ray-cast sphere for one control point, see sphere_impostor.vert.  Shaded
+// like blinnphong.frag.
+
+layout (std140,binding = 0) uniform Camera {
+    mat4 view;
+    mat4 proj;
+	mat4 pv;
+	vec4 cam_pos;
+	vec4 cam_dir;
+	float near;
+	float far;
+};
+
+uniform vec3 eye;           // Centre of projection, in world space
+
+flat in vec3 center;
+flat in float radius;
+flat in vec4 fcolor;
+in vec3 fpos;
+
+// The quad lies in front of the sphere, which lets the depth test still run
+// before the shader.
+layout (depth_greater) out float gl_FragDepth;
+
+out vec4 FragColor;
+
+vec4 calc_light(vec3 light, vec3 pos, vec3 normal, vec4 color) {
+    vec3 light_ray = normalize(light - pos);
+    vec3 view_dir = normalize(vec3(cam_pos)-pos);
+    float diffuse = max(dot(normal,light_ray),0.0f);
+    vec3 reflect_dir = reflect(-light_ray,normal);
+    float spec = pow(max(dot(view_dir,reflect_dir),0.0f),32);
+
+    return (diffuse + 0.2) * color + spec*vec4(1);
+}
+
+void main()
+{
+    vec3 rd = normalize(fpos - eye);
+    vec3 oc = eye - center;
+
+    float b = dot(oc, rd);
+    float c = dot(oc, oc) - radius*radius;
+    float h = b*b - c;
+
+    if (h < 0.0)
+        discard;
+
+    vec3 hit = eye + (-b - sqrt(h))*rd;
+    vec3 normal = (hit - center)/radius;
+
+    vec4 clip = pv*vec4(hit,1);
+    gl_FragDepth = 0.5*(clip.z/clip.w) + 0.5;
+
+    FragColor = calc_light(cam_pos.xyz, hit, normal, fcolor);
+}
@@ -0,0 +1,81 @@
+#version 430 core
+
+// Control points as ray-cast spheres.  Draw 6 vertices per point with no
+// vertex buffers: each point becomes a quad facing the eye, tangent to the
+// front of its sphere and just large enough to cover its silhouette, and
+// sphere_impostor.frag intersects the sphere exactly.
+
+layout (std140,binding = 0) uniform Camera
+{
+    mat4 view;
+    mat4 proj;
+	mat4 pv;
+	vec4 cam_pos;
+	vec4 cam_dir;
+	float near;
+	float far;
+};
+
+struct SpherePointData
+{
+    vec4 position;
+    vec4 color;
+};
+
+layout (std430,binding = 0) readonly buffer PointData
+{
+	SpherePointData data[];
+};
+
+// Same placement as spheres_instanced.vert: a unit sphere scaled by scale,
+// moved to the point, then transformed by model.
+uniform mat4 model;
+uniform float scale;
+uniform vec3 eye;           // Centre of projection, in world space
+uniform int highlight;      // Point drawn enlarged and white, or -1
+
+const float highlightScale = 1.75;
+
+flat out vec3 center;
+flat out float radius;
+flat out vec4 fcolor;
+out vec3 fpos;              // Point on the quad, in world space
+
+const vec2 quadCorners[6] = vec2[](
+    vec2(-1,-1), vec2(1,-1), vec2(1,1),
+    vec2(-1,-1), vec2(1,1), vec2(-1,1));
+
+void main()
+{
+    uint point = uint(gl_VertexID)/6;
+
+    bool highlighted = int(point) == highlight;
+
+    center = vec3(model*vec4(data[point].position.xyz,1));
+    radius = (highlighted ? highlightScale : 1.0)*scale*length(model[0].xyz);
+    fcolor = highlighted ? vec4(1) : data[point].color;
+
+    vec3 toCenter = center - eye;
+    float d = length(toCenter);
+
+    // Nothing sensible to draw from inside the sphere.
+    if (d <= 1.001*radius)
+    {
+        gl_Position = vec4(0,0,0,1);
+        return;
+    }
+
+    vec3 dir = toCenter/d;
+    vec3 u = normalize(cross(dir, abs(dir.z) < 0.9 ? vec3(0,0,1) : vec3(1,0,0)));
+    vec3 v = cross(dir, u);
+
+    // The plane through the sphere's nearest point bounds the sphere from
+    // the front, and cuts its silhouette cone in a circle of radius h.
+    float front = d - radius;
+    float h = front*radius/sqrt(d*d - radius*radius);
+
+    vec2 corner = quadCorners[gl_VertexID % 6];
+    fpos = eye + front*dir + h*(corner.x*u + corner.y*v);
+
+    gl_Position = pv*vec4(fpos,1);
+}
@@ -25,6 +25,9 @@ layout (std430,binding = 0) buffer PointData
 
 uniform mat4 model;
 uniform float scale;
+uniform int highlight;      // Point drawn enlarged and white, or -1
+
+const float highlightScale = 1.75;
 
 layout (location = 0) in vec4 v_pos;
 layout (location = 1) in vec4 v_color;
@@ -37,12 +40,14 @@ out vec3 fnormal;
 void main() {
 
 	vec4 offset = data[gl_InstanceID].position;
+	bool highlighted = gl_InstanceID == highlight;
+	float pointScale = highlighted ? highlightScale*scale : scale;
 	
 	// Apply geometry transformation
-	vec4 position = model*vec4(scale*v_pos.xyz + offset.xyz,1);
+	vec4 position = model*vec4(pointScale*v_pos.xyz + offset.xyz,1);
 	vec4 normal = model*vec4(v_normal.xyz,0);
 
-	fcolor = data[gl_InstanceID].color;
+	fcolor = highlighted ? vec4(1) : data[gl_InstanceID].color;
 	fpos = vec3(position);
 	fnormal = vec3(normal);
 
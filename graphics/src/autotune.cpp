@@ -0,0 +1,199 @@
+#include "autotune.h"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#define AUTOTUNE_REPEATS 5
+
+ShaderDefines localSizeDefines(uint x, uint y, uint z)
+{
+    return {
+        {"LOCAL_SIZE_X", std::to_string(x)},
+        {"LOCAL_SIZE_Y", std::to_string(y)},
+        {"LOCAL_SIZE_Z", std::to_string(z)}
+    };
+}
+
+/**********************************************************************************
+ *
+ * Cache file.  One result per line, tab separated since renderer strings
+ * contain spaces:
+ *
+ *     renderer <TAB> kernel <TAB> config <TAB> NAME=VALUE;NAME=VALUE
+ *
+ **********************************************************************************/
+static std::string formatDefines(const ShaderDefines& defines)
+{
+    std::string text;
+    for (const auto& [name, value] : defines)
+    {
+        if (!text.empty())
+            text.append(";");
+        text.append(name).append("=").append(value);
+    }
+    return text;
+}
+
+static ShaderDefines parseDefines(const std::string& text)
+{
+    ShaderDefines defines;
+    std::stringstream stream(text);
+    std::string item;
+
+    while (std::getline(stream, item, ';'))
+    {
+        size_t equals = item.find('=');
+        if (equals != std::string::npos)
+            defines[item.substr(0, equals)] = item.substr(equals + 1);
+    }
+    return defines;
+}
+
+/**********************************************************************************
+ *
+ * WorkGroupTuner
+ *
+ **********************************************************************************/
+WorkGroupTuner::WorkGroupTuner(const std::string& cachePath) : m_cachePath(cachePath)
+{
+    const GLubyte* renderer = glGetString(GL_RENDERER);
+    m_renderer = renderer ? (const char*)renderer : "unknown";
+}
+
+bool WorkGroupTuner::load()
+{
+    std::ifstream file(m_cachePath);
+    if (!file.is_open())
+        return false;
+
+    m_results.clear();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::stringstream stream(line);
+        Result result;
+        std::string defines;
+
+        if (std::getline(stream, result.renderer, '\t') &&
+            std::getline(stream, result.kernel, '\t') &&
+            std::getline(stream, result.config, '\t') &&
+            std::getline(stream, defines))
+        {
+            result.defines = parseDefines(defines);
+            m_results.push_back(result);
+        }
+    }
+    return true;
+}
+
+bool WorkGroupTuner::save() const
+{
+    std::ofstream file(m_cachePath);
+    if (!file.is_open()) {
+        fprintf(stderr, "ERROR: could not open file: %s \n", m_cachePath.c_str());
+        return false;
+    }
+
+    for (const Result& result : m_results)
+        file << result.renderer << '\t' << result.kernel << '\t' << result.config << '\t' << formatDefines(result.defines) << '\n';
+
+    return file.good();
+}
+
+const ShaderDefines* WorkGroupTuner::best(const std::string& kernel, const std::string& config) const
+{
+    for (const Result& result : m_results)
+        if (result.renderer == m_renderer && result.kernel == kernel && result.config == config)
+            return &result.defines;
+    return nullptr;
+}
+
+/**
+ * Number of invocations a candidate asks for, from its LOCAL_SIZE_* defines.
+ */
+static long long invocations(const ShaderDefines& defines)
+{
+    long long count = 1;
+    for (const char* name : {"LOCAL_SIZE_X", "LOCAL_SIZE_Y", "LOCAL_SIZE_Z"})
+    {
+        auto it = defines.find(name);
+        if (it != defines.end())
+            count *= std::stoll(it->second);
+    }
+    return count;
+}
+
+ShaderDefines WorkGroupTuner::tune(
+    const std::string& kernel,
+    const std::string& config,
+    const std::vector<ShaderDefines>& candidates,
+    const std::function<bool(const ShaderDefines&)>& dispatch)
+{
+    GLint maxInvocations = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    ShaderDefines winner;
+    GLuint64 winnerNs = std::numeric_limits<GLuint64>::max();
+
+    for (const ShaderDefines& candidate : candidates)
+    {
+        if (invocations(candidate) > maxInvocations)
+            continue;
+
+        // Compiles the variant and warms up caches.
+        if (!dispatch(candidate))
+        {
+            fprintf(stderr, "WARNING: skipping %s [%s]: variant could not be built\n", kernel.c_str(), formatDefines(candidate).c_str());
+            continue;
+        }
+        glFinish();
+
+        // Best of several runs, to stay clear of clock ramp-up and other work.
+        GLuint64 bestNs = std::numeric_limits<GLuint64>::max();
+        for (int i = 0; i < AUTOTUNE_REPEATS; i++)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            dispatch(candidate);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            bestNs = std::min(bestNs, ns);
+        }
+
+        printf("autotune: %-20s %-24s %8.3f ms\n", kernel.c_str(), formatDefines(candidate).c_str(), 1e-6*(double)bestNs);
+
+        if (bestNs < winnerNs)
+        {
+            winnerNs = bestNs;
+            winner = candidate;
+        }
+    }
+
+    glDeleteQueries(1, &query);
+
+    if (winner.empty())
+        return winner;
+
+    auto existing = std::find_if(m_results.begin(), m_results.end(), [&](const Result& result)
+    {
+        return result.renderer == m_renderer && result.kernel == kernel && result.config == config;
+    });
+
+    if (existing != m_results.end())
+        existing->defines = winner;
+    else
+        m_results.push_back({m_renderer, kernel, config, winner});
+
+    return winner;
+}
@@ -1,4 +1,5 @@
 #include "camera.h"
+#include "glstate.h"
 #include <complex>
 #include <cstring>
 #include "glm/gtc/type_ptr.hpp"
@@ -28,28 +29,8 @@ Camera::Camera(vec3 normal, vec3 pos, int w, int h, GLfloat FOV, GLfloat near, G
 	far(far),
 	position(pos)
 {
-	glGenBuffers(1, &ubo);
 	coords = mat4(orthCoordsLeft(normal));
 	aspect = (float)h / (float)w;
-
-	updateUbo();
-}
-
-Camera::~Camera()
-{
-	glDeleteBuffers(1,&ubo);
-}
-
-Camera& Camera::operator=(const Camera& other)
-{
-	this->fov = other.fov;
- 	this->coords = other.coords;
- 	this->near = other.near;
- 	this->aspect = other.aspect;
- 	this->far = other.far;
- 	this->position = other.position;
- 	this->updateUbo();
- 	return *this;
 }
 
 mat4 Camera::getViewMatrix() const
@@ -62,12 +43,30 @@ mat4 Camera::getViewMatrix() const
 
 mat4 Camera::getProjMatrix() const
 {
-	return mat4(
+	mat4 proj = mat4(
 		vec4((1 / tan(fov / 2))*(aspect),0,0,0),
 		vec4(0,1 / tan(fov / 2),0,0),
 		vec4(0,0,far/(far - near),1),
 		vec4(0,0,-far*near/(far - near),0)
 	);
+
+	// Map the sub-frustum onto [-1,1] in x and y; depth is unchanged.
+	vec2 scale = 2.0f/(subMax - subMin);
+	vec2 offset = -(subMax + subMin)/(subMax - subMin);
+
+	mat4 tile = mat4(
+		vec4(scale.x,0,0,0),
+		vec4(0,scale.y,0,0),
+		vec4(0,0,1,0),
+		vec4(offset.x,offset.y,0,1)
+	);
+	return tile*proj;
+}
+
+void Camera::setSubFrustum(vec2 ndcMin, vec2 ndcMax)
+{
+	subMin = ndcMin;
+	subMax = ndcMax;
 }
 
 void Camera::updateUbo()
@@ -86,15 +85,17 @@ void Camera::updateUbo()
 		.far = far
 	};
 
-	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUBOLayout), &data, GL_STATIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER,0);
+	// Storage is made once; later updates only write into it.
+	if (!m_ubo)
+		glNamedBufferStorage(m_ubo.get(), sizeof(CameraUBOLayout), &data, GL_DYNAMIC_STORAGE_BIT);
+	else
+		glNamedBufferSubData(m_ubo.id(), 0, sizeof(CameraUBOLayout), &data);
 
 	return;
 }
 void Camera::bindUbo(GLuint binding) const
 {
-	glBindBufferBase(GL_UNIFORM_BUFFER,binding,ubo);
+	glState().bindBufferBase(GL_UNIFORM_BUFFER,binding,m_ubo.id());
 }
 
 void Camera::rotate(float pitch, float yaw)
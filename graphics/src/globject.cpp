@@ -0,0 +1,79 @@
+#include "globject.h"
+
+#include <cstdio>
+
+#include "glstate.h"
+
+static const char* typeName(GLObjectType type)
+{
+    switch (type)
+    {
+        case GL_OBJECT_BUFFER:       return "buffer";
+        case GL_OBJECT_VERTEX_ARRAY: return "vertex array";
+        default:                     return "object";
+    }
+}
+
+GLObjectTracker& glObjects()
+{
+    static GLObjectTracker tracker;
+    return tracker;
+}
+
+void GLObjectTracker::created(GLObjectType type, GLuint name)
+{
+    m_live[type]++;
+    m_total[type]++;
+
+#ifndef NDEBUG
+    m_names[type].insert(name);
+#endif
+}
+
+void GLObjectTracker::deleted(GLObjectType type, GLuint name)
+{
+#ifndef NDEBUG
+    if (!m_names[type].erase(name))
+    {
+        fprintf(stderr, "ERROR: deleting %s %u, which is not alive\n", typeName(type), name);
+        return;
+    }
+#endif
+
+    m_live[type]--;
+}
+
+/**********************************************************************************
+ *
+ * Creation and deletion per type
+ *
+ **********************************************************************************/
+template<> GLuint glObjectCreate<GL_OBJECT_BUFFER>()
+{
+    GLuint name;
+    glCreateBuffers(1, &name);
+    glObjects().created(GL_OBJECT_BUFFER, name);
+    return name;
+}
+
+template<> void glObjectDelete<GL_OBJECT_BUFFER>(GLuint name)
+{
+    glObjects().deleted(GL_OBJECT_BUFFER, name);
+    glState().forgetBuffer(name);
+    glDeleteBuffers(1, &name);
+}
+
+template<> GLuint glObjectCreate<GL_OBJECT_VERTEX_ARRAY>()
+{
+    GLuint name;
+    glCreateVertexArrays(1, &name);
+    glObjects().created(GL_OBJECT_VERTEX_ARRAY, name);
+    return name;
+}
+
+template<> void glObjectDelete<GL_OBJECT_VERTEX_ARRAY>(GLuint name)
+{
+    glObjects().deleted(GL_OBJECT_VERTEX_ARRAY, name);
+    glState().forgetVertexArray(name);
+    glDeleteVertexArrays(1, &name);
+}
@@ -0,0 +1,160 @@
+#include "glstate.h"
+
+#include <cstdio>
+
+#define GLSTATE_UNKNOWN (~0u)
+
+GLStateCache& glState()
+{
+    static GLStateCache cache;
+    return cache;
+}
+
+bool checkGLVersion()
+{
+    if (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access)
+        return true;
+
+    fprintf(stderr, "ERROR: OpenGL %d.%d or ARB_direct_state_access is required, got %s\n",
+        HOPF_GL_MAJOR, HOPF_GL_MINOR, (const char*)glGetString(GL_VERSION));
+    return false;
+}
+
+/**
+ * Set tracked to value, returning whether GL needs to be told.
+ */
+static bool update(GLuint& tracked, GLuint value, GLStateStats& stats)
+{
+    if (tracked == value)
+    {
+        stats.skipped++;
+        return false;
+    }
+
+    tracked = value;
+    stats.issued++;
+    return true;
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (update(m_program, program, m_frame))
+        glUseProgram(program);
+}
+
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+    if (update(m_vao, vao, m_frame))
+        glBindVertexArray(vao);
+}
+
+GLStateCache::BufferBinding* GLStateCache::bindings(GLenum target, GLuint index)
+{
+    if (index >= GLSTATE_MAX_BUFFER_BINDINGS)
+        return nullptr;
+
+    if (target == GL_UNIFORM_BUFFER)
+        return &m_uniformBuffers[index];
+    if (target == GL_SHADER_STORAGE_BUFFER)
+        return &m_storageBuffers[index];
+
+    return nullptr;
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    BufferBinding* binding = bindings(target, index);
+    BufferBinding value = {buffer, 0, 0};
+
+    if (binding && *binding == value)
+    {
+        m_frame.skipped++;
+        return;
+    }
+
+    if (binding)
+        *binding = value;
+
+    m_frame.issued++;
+    glBindBufferBase(target, index, buffer);
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    BufferBinding* binding = bindings(target, index);
+    BufferBinding value = {buffer, offset, size};
+
+    if (binding && *binding == value)
+    {
+        m_frame.skipped++;
+        return;
+    }
+
+    if (binding)
+        *binding = value;
+
+    m_frame.issued++;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    if (target != GL_DISPATCH_INDIRECT_BUFFER)
+    {
+        m_frame.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (update(m_dispatchIndirectBuffer, buffer, m_frame))
+        glBindBuffer(target, buffer);
+}
+
+void GLStateCache::forgetBuffer(GLuint buffer)
+{
+    // Whether GL resets indexed bindings of a deleted buffer has varied
+    // between drivers, so treat them as unknown.
+    for (int i = 0; i < GLSTATE_MAX_BUFFER_BINDINGS; i++)
+    {
+        if (m_uniformBuffers[i].buffer == buffer)
+            m_uniformBuffers[i].buffer = GLSTATE_UNKNOWN;
+        if (m_storageBuffers[i].buffer == buffer)
+            m_storageBuffers[i].buffer = GLSTATE_UNKNOWN;
+    }
+
+    if (m_dispatchIndirectBuffer == buffer)
+        m_dispatchIndirectBuffer = 0;
+}
+
+void GLStateCache::forgetVertexArray(GLuint vao)
+{
+    if (m_vao == vao)
+        m_vao = 0;
+}
+
+void GLStateCache::forgetProgram(GLuint program)
+{
+    // A deleted program stays in use until another is installed, so only
+    // its name is unsafe to compare against.
+    if (m_program == program)
+        m_program = GLSTATE_UNKNOWN;
+}
+
+void GLStateCache::invalidate()
+{
+    m_program = GLSTATE_UNKNOWN;
+    m_vao = GLSTATE_UNKNOWN;
+    m_dispatchIndirectBuffer = GLSTATE_UNKNOWN;
+
+    for (int i = 0; i < GLSTATE_MAX_BUFFER_BINDINGS; i++)
+    {
+        m_uniformBuffers[i] = {GLSTATE_UNKNOWN, 0, 0};
+        m_storageBuffers[i] = {GLSTATE_UNKNOWN, 0, 0};
+    }
+}
+
+void GLStateCache::beginFrame()
+{
+    m_lastFrame = m_frame;
+    m_frame = GLStateStats();
+}
@@ -0,0 +1,232 @@
+#include "gpuarena.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1)/alignment*alignment;
+}
+
+GpuArena::GpuArena(size_t blockSize, size_t segmentSize) :
+    m_blockSize(blockSize), m_segmentSize(segmentSize)
+{
+}
+
+GpuArena::~GpuArena()
+{
+    for (GLsync fence : m_segmentFences)
+        if (fence)
+            glDeleteSync(fence);
+}
+
+size_t GpuArena::alignment()
+{
+    if (!m_alignment)
+    {
+        GLint storage = 0, uniform = 0;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage);
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform);
+
+        // vec4 members need at least 16 bytes.
+        m_alignment = std::max<size_t>({16, (size_t)storage, (size_t)uniform});
+    }
+    return m_alignment;
+}
+
+GLBuffer GpuArena::createStorage(size_t size)
+{
+    if (m_budget && reserved() + size > m_budget && !m_overBudget)
+    {
+        fprintf(stderr, "WARNING: GPU arena over budget: %zu of %zu bytes\n", reserved() + size, m_budget);
+        m_overBudget = true;
+    }
+
+    GLBuffer buffer;
+    glNamedBufferStorage(buffer.get(), size, nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    return buffer;
+}
+
+void GpuArena::track(const std::string& subsystem, long long bytes)
+{
+    GpuArenaUsage& usage = m_usage[subsystem];
+
+    usage.live += bytes;
+    usage.peak = std::max(usage.peak, usage.live);
+
+    if (bytes > 0)
+        usage.allocations++;
+    else if (bytes < 0)
+        usage.allocations--;
+}
+
+/**********************************************************************************
+ *
+ * Persistent ranges.  First fit over each block's free runs, which are
+ * merged with their neighbours on release.  Sizes are rounded up to the
+ * alignment so every run stays aligned.
+ *
+ **********************************************************************************/
+GpuRange GpuArena::allocate(size_t size, const std::string& subsystem)
+{
+    if (!size)
+        return GpuRange();
+
+    size = alignUp(size, alignment());
+
+    Block* target = nullptr;
+    std::map<size_t, size_t>::iterator run;
+
+    for (Block& block : m_blocks)
+    {
+        run = std::find_if(block.free.begin(), block.free.end(), [&](const auto& free)
+        {
+            return free.second >= size;
+        });
+
+        if (run != block.free.end())
+        {
+            target = &block;
+            break;
+        }
+    }
+
+    if (!target)
+    {
+        size_t blockSize = std::max(m_blockSize, size);
+        m_blocks.push_back({createStorage(blockSize), blockSize, {{0, blockSize}}});
+        target = &m_blocks.back();
+        run = target->free.begin();
+    }
+
+    size_t offset = run->first;
+    size_t remaining = run->second - size;
+
+    target->free.erase(run);
+    if (remaining)
+        target->free[offset + size] = remaining;
+
+    m_allocations[{target->buffer.id(), offset}] = {subsystem, size};
+    track(subsystem, (long long)size);
+
+    return {target->buffer.id(), offset, size};
+}
+
+void GpuArena::release(const GpuRange& range)
+{
+    auto allocation = m_allocations.find({range.buffer, range.offset});
+    if (allocation == m_allocations.end())
+        return;
+
+    auto [subsystem, size] = allocation->second;
+    m_allocations.erase(allocation);
+    track(subsystem, -(long long)size);
+
+    for (Block& block : m_blocks)
+    {
+        if (block.buffer.id() != range.buffer)
+            continue;
+
+        size_t offset = range.offset;
+        auto next = block.free.lower_bound(offset);
+
+        if (next != block.free.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = block.free.erase(next);
+        }
+
+        if (next != block.free.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+
+        block.free[offset] = size;
+        return;
+    }
+}
+
+size_t GpuArena::reserved() const
+{
+    size_t bytes = m_ring ? GPU_ARENA_FRAMES*m_segmentSize : 0;
+
+    for (const Block& block : m_blocks)
+        bytes += block.size;
+
+    return bytes;
+}
+
+/**********************************************************************************
+ *
+ * Transient ranges
+ *
+ **********************************************************************************/
+void GpuArena::nextSegment()
+{
+    // Fence what was issued against this segment, then wait until the GPU is
+    // done with the oldest one before handing it out again.
+    bool used = m_segmentUsed || !m_segmentOversized[m_segment].empty();
+
+    if (m_segmentFences[m_segment])
+        glDeleteSync(m_segmentFences[m_segment]);
+    m_segmentFences[m_segment] = used ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+
+    m_segment = (m_segment + 1) % GPU_ARENA_FRAMES;
+    m_segmentUsed = 0;
+
+    if (GLsync fence = m_segmentFences[m_segment])
+    {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        m_segmentFences[m_segment] = 0;
+    }
+
+    for (const GpuRange& range : m_segmentOversized[m_segment])
+        release(range);
+    m_segmentOversized[m_segment].clear();
+}
+
+GpuRange GpuArena::allocateTransient(size_t size, const std::string& subsystem)
+{
+    if (!m_ring)
+        m_ring = createStorage(GPU_ARENA_FRAMES*m_segmentSize);
+
+    size = alignUp(size, alignment());
+
+    // Too big for any segment: a persistent range, freed with the segment
+    // current now once the GPU is done with it.
+    if (size > m_segmentSize)
+    {
+        GpuRange range = allocate(size, subsystem);
+        m_segmentOversized[m_segment].push_back(range);
+        return range;
+    }
+
+    // A frame that outgrows its segment moves on to the next one.
+    if (m_segmentUsed + size > m_segmentSize)
+        nextSegment();
+
+    GpuRange range = {m_ring.id(), m_segment*m_segmentSize + m_segmentUsed, size};
+    m_segmentUsed += size;
+
+    m_frameTransients.push_back({subsystem, size});
+    track(subsystem, (long long)size);
+
+    return range;
+}
+
+void GpuArena::beginFrame()
+{
+    for (const auto& [subsystem, size] : m_frameTransients)
+        track(subsystem, -(long long)size);
+    m_frameTransients.clear();
+
+    if (m_segmentUsed || !m_segmentOversized[m_segment].empty())
+        nextSegment();
+}
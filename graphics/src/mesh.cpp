@@ -118,11 +118,11 @@ void MeshGen::polylineMesh(Buffer& lines, Buffer& instances, PrimitiveData<Verte
     uint detail = resolution;
 
 	//set up bindings on GPU
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,lines.id());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,instances.id());
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,tempData.id());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,mesh.vbo()->id());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,4,mesh.ebo()->id());
+	glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,lines.id());
+	glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,instances.id());
+	glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,2,tempData.id());
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,3,mesh.vbo()->id());
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,4,mesh.ebo()->id());
 
     uint localSizeX = 32;
     uint localSizeY = 16;
@@ -140,6 +140,33 @@ void MeshGen::polylineMesh(Buffer& lines, Buffer& instances, PrimitiveData<Verte
 
 	glDispatchCompute(nGroupsX,nGroupsY,nGroupsZ);
 
-	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void MeshGen::surfaceMesh(PrimitiveData<Vertex>& mesh, SurfacePreset surface, 
+    uint uCount, uint vCount, int b1, int b2, float time)
+{
+    size_t vertexCount = uCount*vCount;
+
+    if (mesh.attribCount() < vertexCount)
+        mesh.reserveAttribs(vertexCount);
+    if (mesh.indexCount() < 6*vertexCount)
+        mesh.reserveIndices(6*vertexCount);
+
+    ShaderProgram shader = shaders->program("surface_mesh");
+
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,0,mesh.vbo()->id());
+    glState().bindBufferBase(GL_SHADER_STORAGE_BUFFER,1,mesh.ebo()->id());
+
+    shader.use();
+    shader.setUniform("uCount",uCount);
+    shader.setUniform("vCount",vCount);
+    shader.setUniform("b1",b1);
+    shader.setUniform("b2",b2);
+    shader.setUniform("surface",(int)surface);
+    shader.setUniform("time",time);
+    shader.dispatchCompute(uCount,vCount,1);
+
+
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
 }
@@ -1,5 +1,10 @@
 #include "renderer.h"
 
+#include <algorithm>
+#include <utility>
+
+#include "glstate.h"
+
 int* MultiIndex::firsts()
 {
     return indices.data();
@@ -16,39 +21,171 @@ int MultiIndex::totalCount()
 }
 
 
-Buffer::Buffer() : m_size(0) , m_id(0)
+Buffer::Buffer(size_t size,GLenum usage)
 {
-   glGenBuffers(1,&m_id);
+    reserve(size,usage);
 }
 
-Buffer::Buffer(size_t size,GLenum usage) : m_size(size) , m_id(0)
+Buffer::~Buffer()
 {
-    glBindBuffer(GL_ARRAY_BUFFER,m_id);
-    glBufferData(GL_ARRAY_BUFFER,size,nullptr,usage);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+    releaseRange();
 }
 
-Buffer::~Buffer()
+Buffer::Buffer(Buffer&& other) :
+    m_storage(std::move(other.m_storage)),
+    m_size(other.m_size),
+    m_capacity(other.m_capacity),
+    m_usage(other.m_usage),
+    m_arena(other.m_arena),
+    m_subsystem(std::move(other.m_subsystem)),
+    m_range(other.m_range)
+{
+    // The moved-from buffer keeps no storage, so it frees nothing.
+    other.m_size = other.m_capacity = 0;
+    other.m_range = GpuRange();
+}
+
+Buffer& Buffer::operator=(Buffer&& other)
+{
+    if (this == &other)
+        return *this;
+
+    releaseRange();
+
+    m_storage = std::move(other.m_storage);
+    m_size = other.m_size;
+    m_capacity = other.m_capacity;
+    m_usage = other.m_usage;
+    m_arena = other.m_arena;
+    m_subsystem = std::move(other.m_subsystem);
+    m_range = other.m_range;
+
+    other.m_size = other.m_capacity = 0;
+    other.m_range = GpuRange();
+    return *this;
+}
+
+void Buffer::releaseRange()
+{
+    if (m_arena && m_range.size)
+        m_arena->release(m_range);
+    m_range = GpuRange();
+}
+
+void Buffer::setArena(GpuArena* arena, const std::string& subsystem)
+{
+    // The arena hands out names along with the ranges.
+    m_storage.reset();
+
+    m_arena = arena;
+    m_subsystem = subsystem;
+}
+
+void Buffer::allocate(size_t capacity, GLenum usage)
+{
+    m_usage = usage;
+
+    if (m_arena)
+    {
+        releaseRange();
+        m_range = m_arena->allocate(capacity,m_subsystem);
+        m_capacity = m_range.size;
+        return;
+    }
+
+    glNamedBufferData(id(),capacity,nullptr,usage);
+    m_capacity = capacity;
+}
+
+void Buffer::grow(size_t capacity)
 {
-    glDeleteBuffers(1,&m_id);
+    if (m_arena)
+    {
+        // Copy straight into the new range before giving up the old one.
+        GpuRange range = m_arena->allocate(capacity,m_subsystem);
+
+        if (m_size)
+            glCopyNamedBufferSubData(m_range.buffer,range.buffer,m_range.offset,range.offset,m_size);
+        releaseRange();
+
+        m_range = range;
+        m_capacity = range.size;
+        return;
+    }
+
+    // Reallocate under the same name, so VAOs and bindings stay valid, and
+    // carry the contents over through a temporary GPU copy.
+    GLBuffer temp;
+
+    if (m_size)
+    {
+        glNamedBufferData(temp.get(),m_size,nullptr,GL_STREAM_COPY);
+        glCopyNamedBufferSubData(id(),temp.id(),0,0,m_size);
+    }
+
+    allocate(capacity,m_usage);
+
+    if (temp)
+        glCopyNamedBufferSubData(temp.id(),id(),0,0,m_size);
 }
 
-void Buffer::uploadData(void* data, size_t size, GLenum usage)
+void Buffer::uploadData(const void* data, size_t size, GLenum usage, BufferUploadHint hint)
 {
-    glBindBuffer(GL_ARRAY_BUFFER,m_id);
-    if (size < m_size)
-        glBufferSubData(GL_ARRAY_BUFFER,0,size,data);
-    else 
-        glBufferData(GL_ARRAY_BUFFER,size,data,usage);
+    // New storage needs no invalidation; otherwise every old byte is dead.
+    if (size > m_capacity)
+        allocate(std::max(size, 2*m_capacity),usage);
+    else if (hint != BUFFER_UPLOAD_DEFAULT && m_capacity)
+        invalidate(0,m_capacity);
+
     m_size = size;
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+
+    if (!size)
+        return;
+
+    glNamedBufferSubData(id(),m_range.offset,size,data);
+}
+
+void Buffer::uploadSubData(const void* data, size_t offset, size_t size, BufferUploadHint hint)
+{
+    if (!size)
+        return;
+
+    size_t end = offset + size;
+
+    if (end > m_capacity)
+        grow(std::max(end, 2*m_capacity));
+    else if (hint == BUFFER_UPLOAD_ORPHAN)
+        invalidate(0,m_capacity);
+    else if (hint == BUFFER_UPLOAD_INVALIDATE)
+        invalidate(offset,size);
+
+    glNamedBufferSubData(id(),m_range.offset + offset,size,data);
+
+    m_size = std::max(m_size, end);
+}
+
+void Buffer::invalidate(size_t offset, size_t size)
+{
+    // Only this buffer's range of a shared arena block may be discarded.
+    if (m_arena || offset || size < m_capacity)
+        glInvalidateBufferSubData(id(),m_range.offset + offset,size);
+    else
+        glInvalidateBufferData(id());
+}
+
+void Buffer::bind(GLenum target, GLuint index) const
+{
+    if (m_arena)
+        glState().bindBufferRange(target,index,m_range.buffer,m_range.offset,m_capacity);
+    else
+        glState().bindBufferBase(target,index,id());
 }
 
 void Buffer::reserve(size_t size,GLenum usage)
 {
-    glBindBuffer(GL_ARRAY_BUFFER,m_id);
-    glBufferData(GL_ARRAY_BUFFER,size,nullptr,usage);
-    glBindBuffer(GL_ARRAY_BUFFER,0);
+    if (size > m_capacity)
+        allocate(size,usage);
+
     m_size = size;
 }
 
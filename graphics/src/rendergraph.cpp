@@ -0,0 +1,416 @@
+#include "rendergraph.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+#include "glstate.h"
+
+/**********************************************************************************
+ *
+ * BufferHazards
+ *
+ **********************************************************************************/
+
+// Every bit an access below can need.
+#define HAZARD_ALL_BITS ( \
+    GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | \
+    GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | \
+    GL_UNIFORM_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT)
+
+BufferHazards& bufferHazards()
+{
+    static BufferHazards hazards;
+    return hazards;
+}
+
+/**
+ * Barrier bit that makes shader writes visible to each kind of access.
+ */
+static GLbitfield barrierBits(uint usage)
+{
+    GLbitfield bits = 0;
+
+    if (usage & (USAGE_STORAGE_READ | USAGE_STORAGE_WRITE)) bits |= GL_SHADER_STORAGE_BARRIER_BIT;
+    if (usage & USAGE_VERTEX)   bits |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+    if (usage & USAGE_INDEX)    bits |= GL_ELEMENT_ARRAY_BARRIER_BIT;
+    if (usage & USAGE_INDIRECT) bits |= GL_COMMAND_BARRIER_BIT;
+    if (usage & USAGE_UNIFORM)  bits |= GL_UNIFORM_BARRIER_BIT;
+    if (usage & USAGE_UPDATE)   bits |= GL_BUFFER_UPDATE_BARRIER_BIT;
+
+    return bits;
+}
+
+BufferAccess bufferAccess(const Buffer& buffer, uint usage)
+{
+    return {buffer.id(), usage, buffer.offset(), buffer.capacity()};
+}
+
+/**
+ * End of the range access covers.
+ */
+static size_t accessEnd(const BufferAccess& access)
+{
+    return access.size ? access.offset + access.size : SIZE_MAX;
+}
+
+GLbitfield BufferHazards::required(const BufferAccess& access) const
+{
+    GLbitfield bits = 0;
+    size_t end = accessEnd(access);
+
+    // Arena ranges are reused at other offsets, so any overlap counts.
+    for (auto it = m_buffers.lower_bound({access.buffer, 0}); it != m_buffers.end() && it->first.first == access.buffer; ++it)
+    {
+        const State& state = it->second;
+        if (it->first.second >= end || state.end <= access.offset)
+            continue;
+
+        bits |= state.unflushed & barrierBits(access.usage);
+
+        // A shader write may otherwise overtake shader reads still in flight.
+        // Other writes are ordered against reads by GL itself.
+        if ((access.usage & USAGE_STORAGE_WRITE) && state.storageRead)
+            bits |= GL_SHADER_STORAGE_BARRIER_BIT;
+    }
+
+    return bits;
+}
+
+bool BufferHazards::prepare(const std::vector<BufferAccess>& accesses)
+{
+    GLbitfield bits = 0;
+    for (const BufferAccess& access : accesses)
+        bits |= required(access);
+
+    if (bits)
+    {
+        glMemoryBarrier(bits);
+        barrier(bits);
+    }
+
+    for (const BufferAccess& access : accesses)
+        accessed(access);
+
+    return bits != 0;
+}
+
+void BufferHazards::barrier(GLbitfield bits)
+{
+    for (auto it = m_buffers.begin(); it != m_buffers.end();)
+    {
+        State& state = it->second;
+        state.unflushed &= ~bits;
+
+        if (bits & GL_SHADER_STORAGE_BARRIER_BIT)
+            state.storageRead = false;
+
+        // Buffers with nothing pending need no entry.
+        if (!state.unflushed && !state.storageRead)
+            it = m_buffers.erase(it);
+        else
+            ++it;
+    }
+}
+
+void BufferHazards::retired(const BufferAccess& access)
+{
+    size_t end = accessEnd(access);
+
+    for (auto it = m_buffers.lower_bound({access.buffer, 0}); it != m_buffers.end() && it->first.first == access.buffer;)
+    {
+        State& state = it->second;
+
+        if (it->first.second < end && state.end > access.offset)
+            state.storageRead = false;
+
+        if (!state.unflushed && !state.storageRead)
+            it = m_buffers.erase(it);
+        else
+            ++it;
+    }
+}
+
+void BufferHazards::accessed(const BufferAccess& access)
+{
+    if (!access.buffer || !(access.usage & (USAGE_STORAGE_READ | USAGE_STORAGE_WRITE)))
+        return;
+
+    State& state = m_buffers[{access.buffer, access.offset}];
+    state.end = std::max(state.end, accessEnd(access));
+
+    if (access.usage & USAGE_STORAGE_WRITE)
+        state.unflushed = HAZARD_ALL_BITS;
+    if (access.usage & USAGE_STORAGE_READ)
+        state.storageRead = true;
+}
+
+/**********************************************************************************
+ *
+ * RenderGraph
+ *
+ **********************************************************************************/
+RenderGraph::RenderGraph(GpuArena* arena, const std::string& subsystem) :
+    m_arena(arena), m_subsystem(subsystem)
+{
+}
+
+RGResource RenderGraph::import(const std::string& name, const Buffer& buffer)
+{
+    Resource resource;
+    resource.name = name;
+    resource.buffer = buffer.id();
+    resource.offset = buffer.offset();
+    resource.size = buffer.capacity();
+
+    m_resources.push_back(resource);
+    return (RGResource)(m_resources.size() - 1);
+}
+
+RGResource RenderGraph::transient(const std::string& name, size_t size)
+{
+    Resource resource;
+    resource.name = name;
+    resource.size = size;
+    resource.transient = true;
+
+    m_resources.push_back(resource);
+    return (RGResource)(m_resources.size() - 1);
+}
+
+void RenderGraph::output(RGResource resource)
+{
+    m_resources[resource].output = true;
+}
+
+void RenderGraph::addPass(
+    const std::string& name,
+    std::vector<PassAccess> accesses,
+    std::function<void(RenderGraph&)> run)
+{
+    m_passes.push_back({name, std::move(accesses), std::move(run)});
+}
+
+GLuint RenderGraph::buffer(RGResource resource) const
+{
+    return m_resources[resource].buffer;
+}
+
+size_t RenderGraph::offset(RGResource resource) const
+{
+    return m_resources[resource].offset;
+}
+
+void RenderGraph::bind(GLenum target, GLuint index, RGResource resource) const
+{
+    const Resource& r = m_resources[resource];
+
+    // Ranges bind just as well for whole buffers, and arena ranges need one.
+    if (r.size)
+        glState().bindBufferRange(target, index, r.buffer, r.offset, r.size);
+    else
+        glState().bindBufferBase(target, index, r.buffer);
+}
+
+void RenderGraph::upload(RGResource resource, const void* data, size_t size) const
+{
+    const Resource& r = m_resources[resource];
+    glNamedBufferSubData(r.buffer, r.offset, size, data);
+}
+
+void RenderGraph::cull()
+{
+    // Walk back from the outputs.  Writes do not end a resource's lifetime,
+    // since passes may only update part of it.
+    std::vector<bool> needed(m_resources.size());
+    for (size_t i = 0; i < m_resources.size(); i++)
+        needed[i] = m_resources[i].output;
+
+    for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass)
+    {
+        bool writes = false;
+        bool live = false;
+
+        for (const PassAccess& access : pass->accesses)
+        {
+            if (access.usage & USAGE_WRITES)
+            {
+                writes = true;
+                live = live || needed[access.resource];
+            }
+        }
+
+        pass->live = live || !writes;
+        if (!pass->live)
+            continue;
+
+        for (const PassAccess& access : pass->accesses)
+            if (access.usage & ~USAGE_WRITES)
+                needed[access.resource] = true;
+    }
+}
+
+bool RenderGraph::placeTransients()
+{
+    struct Lifetime
+    {
+        RGResource resource;
+        int first;
+        int last;
+    };
+
+    std::vector<Lifetime> lifetimes;
+
+    for (RGResource r = 0; r < m_resources.size(); r++)
+    {
+        if (!m_resources[r].transient)
+            continue;
+
+        Lifetime lifetime = {r, -1, -1};
+
+        for (int i = 0; i < (int)m_passes.size(); i++)
+        {
+            if (!m_passes[i].live)
+                continue;
+
+            for (const PassAccess& access : m_passes[i].accesses)
+            {
+                if (access.resource != r)
+                    continue;
+
+                if (lifetime.first < 0)
+                    lifetime.first = i;
+                lifetime.last = i;
+            }
+        }
+
+        if (lifetime.first >= 0)
+            lifetimes.push_back(lifetime);
+    }
+
+    std::sort(lifetimes.begin(), lifetimes.end(), [](const Lifetime& a, const Lifetime& b)
+    {
+        return a.first < b.first;
+    });
+
+    // Transients sharing a slot share one arena range, sized for the
+    // largest.  Each goes to the free slot closest to its size, growing the
+    // largest free one if none fits.
+    struct Slot
+    {
+        int busyUntil;
+        size_t size;
+        std::vector<RGResource> resources;
+    };
+
+    std::vector<Slot> slots;
+
+    for (const Lifetime& lifetime : lifetimes)
+    {
+        size_t size = m_resources[lifetime.resource].size;
+        int best = -1;
+
+        for (int i = 0; i < (int)slots.size(); i++)
+        {
+            if (slots[i].busyUntil >= lifetime.first)
+                continue;
+
+            if (best < 0)
+            {
+                best = i;
+                continue;
+            }
+
+            bool fits = slots[i].size >= size;
+            bool bestFits = slots[best].size >= size;
+
+            if (fits ? (!bestFits || slots[i].size < slots[best].size) : (!bestFits && slots[i].size > slots[best].size))
+                best = i;
+        }
+
+        if (best < 0)
+        {
+            slots.push_back({-1, 0, {}});
+            best = (int)slots.size() - 1;
+        }
+
+        slots[best].busyUntil = lifetime.last;
+        slots[best].size = std::max(slots[best].size, size);
+        slots[best].resources.push_back(lifetime.resource);
+    }
+
+    if (!slots.empty() && !m_arena)
+    {
+        fprintf(stderr, "ERROR: render graph has transients but no arena\n");
+        return false;
+    }
+
+    for (const Slot& slot : slots)
+    {
+        GpuRange range = m_arena->allocateTransient(slot.size, m_subsystem);
+
+        if (!range.buffer)
+        {
+            fprintf(stderr, "ERROR: could not place %zu transient bytes for %s\n", slot.size, m_resources[slot.resources[0]].name.c_str());
+            return false;
+        }
+
+        for (RGResource r : slot.resources)
+        {
+            m_resources[r].buffer = range.buffer;
+            m_resources[r].offset = range.offset;
+        }
+
+        m_stats.transientBytes += range.size;
+    }
+
+    return true;
+}
+
+bool RenderGraph::execute()
+{
+    m_stats = RenderGraphStats();
+
+    cull();
+
+    // Passes would otherwise run on unbacked transients.
+    if (!placeTransients())
+    {
+        m_passes.clear();
+        m_resources.clear();
+        return false;
+    }
+
+    BufferHazards& hazards = bufferHazards();
+
+    for (Pass& pass : m_passes)
+    {
+        if (!pass.live)
+        {
+            m_stats.culled++;
+            continue;
+        }
+
+        GLbitfield bits = 0;
+        for (const PassAccess& access : pass.accesses)
+            bits |= hazards.required({buffer(access.resource), access.usage, offset(access.resource), m_resources[access.resource].size});
+
+        if (bits)
+        {
+            glMemoryBarrier(bits);
+            hazards.barrier(bits);
+            m_stats.barriers++;
+        }
+
+        pass.run(*this);
+
+        for (const PassAccess& access : pass.accesses)
+            hazards.accessed({buffer(access.resource), access.usage, offset(access.resource), m_resources[access.resource].size});
+
+        m_stats.passes++;
+    }
+
+    m_passes.clear();
+    m_resources.clear();
+    return true;
+}
@@ -9,6 +9,7 @@
 #include <vector>
 #include <fstream>
 #include <filesystem>
+#include <unordered_set>
 
 #define MAX_LINE_LENGTH 100
 
@@ -32,8 +33,91 @@ inline std::string read_text_file(const char* src){
 	return text;
 }
 
+/**
+ * Read the shader at path, replacing each #include "file" line with the file's
+ * contents.  Paths are relative to the including file; files already in
+ * included are skipped.  #line directives keep compiler messages pointing at
+ * the right line of each file.
+ */
+static bool expandIncludes(const fs::path& path, std::unordered_set<std::string>& included, std::string& out, bool isInclude)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		fprintf(stderr, "ERROR: could not open file: %s \n", path.string().c_str());
+		return false;
+	}
+
+	included.insert(fs::weakly_canonical(path).string());
+
+	if (isInclude)
+		out.append("#line 1\n");
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file,line))
+	{
+		lineNumber++;
+
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include"))
+		{
+			out.append(line).append("\n");
+			continue;
+		}
+
+		size_t open = line.find('"', start);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos) {
+			fprintf(stderr, "ERROR: malformed #include in %s:%d \n", path.string().c_str(), lineNumber);
+			return false;
+		}
+
+		fs::path includePath = path.parent_path() / line.substr(open + 1, close - open - 1);
+		if (!included.count(fs::weakly_canonical(includePath).string()))
+		{
+			if (!expandIncludes(includePath, included, out, true))
+				return false;
+		}
+		out.append("#line ").append(std::to_string(lineNumber + 1)).append("\n");
+	}
+	return true;
+}
+
+/**
+ * Insert a #define for each entry of defines after the #version line, which
+ * must come first in GLSL.
+ */
+static std::string injectDefines(const std::string& source, const ShaderDefines& defines)
+{
+	if (defines.empty())
+		return source;
+
+	size_t version = source.find("#version");
+	size_t insertAt = version == std::string::npos ? 0 : source.find('\n', version);
+	insertAt = insertAt == std::string::npos ? source.size() : insertAt + 1;
+
+	std::string block;
+	for (const auto& [name, value] : defines)
+		block.append("#define ").append(name).append(" ").append(value).append("\n");
+	block.append("#line 2\n");
+
+	return source.substr(0, insertAt) + block + source.substr(insertAt);
+}
+
+static std::string variantKey(const std::string& name, const ShaderDefines& defines)
+{
+	std::string key = name;
+	for (const auto& [define, value] : defines)
+		key.append("|").append(define).append("=").append(value);
+	return key;
+}
+
 void ShaderProgram::dispatchCompute(const uint countX, const uint countY, const uint countZ)
 {
+    // Already reported when the variant failed to build.
+    if (!valid())
+        return;
+
     GLint localSizes[3];
     glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, localSizes);
     
@@ -43,6 +127,26 @@ void ShaderProgram::dispatchCompute(const uint countX, const uint countY, const
     glDispatchCompute(nGroupsX,nGroupsY,nGroupsZ);
 }
 
+void ShaderProgram::dispatchComputeIndirect(GLuint buffer, GLintptr offset)
+{
+    if (!valid())
+        return;
+
+    glState().bindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer);
+    glDispatchComputeIndirect(offset);
+}
+
+void ShaderProgram::workGroupSize(GLint sizes[3]) const
+{
+    if (!valid())
+    {
+        sizes[0] = sizes[1] = sizes[2] = 1;
+        return;
+    }
+
+    glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, sizes);
+}
+
 void ShaderProgram::setUniform(const char* name, int value)
 {
 	glUniform1i(this->getUniform(name), value);
@@ -57,6 +161,11 @@ void ShaderProgram::setUniform(const char* name, float value)
 	glUniform1f(this->getUniform(name), value);
 }
 
+void ShaderProgram::setUniform(const char* name, vec2 value)
+{
+	glUniform2fv(this->getUniform(name), 1, glm::value_ptr(value));
+}
+
 void ShaderProgram::setUniform(const char* name, vec3 value)
 {
 	glUniform3fv(this->getUniform(name), 1, glm::value_ptr(value));
@@ -93,13 +202,6 @@ bool ShaderManager::addShader(const std::string& path)
 
 bool ShaderManager::addShader(const std::string& name, const std::string& path)
 {
-	std::string source = read_text_file(path.c_str());
-
-	if (source == "") {
-		fprintf(stderr, "ERROR: could not open shader file: %s \n", path.c_str());
-		return false;
-	}
-
 	std::string ext = fs::path(path).extension().string();
 
 	GLuint type = 0;
@@ -113,9 +215,18 @@ bool ShaderManager::addShader(const std::string& name, const std::string& path)
 	if (ext == ".geom")
 		type = GL_GEOMETRY_SHADER;
 	
-	// TODO: parse files when given glsl or tess.
+	// .glsl files are only pulled in by #include.
+	// TODO: parse files when given tess.
 
 	if (!type) return false;
+
+	std::string source;
+	std::unordered_set<std::string> included;
+
+	if (!expandIncludes(path, included, source, false) || source == "") {
+		fprintf(stderr, "ERROR: could not open shader file: %s \n", path.c_str());
+		return false;
+	}
 	
 	GLuint shader = compileShader(type, source.c_str());
 
@@ -130,6 +241,7 @@ bool ShaderManager::addShader(const std::string& name, const std::string& path)
 	if(shader)
 	{
 		m_shaders[name] = shader;
+		m_sources[name] = {type, source};
 		return true;
 	}
 	return false;
@@ -137,39 +249,30 @@ bool ShaderManager::addShader(const std::string& name, const std::string& path)
 
 bool ShaderManager::addProgram(const std::string& name, const std::vector<std::string>& shaders)
 {
-	GLuint program = glCreateProgram();
+	std::vector<GLuint> ids;
 
 	for (auto& shaderName : shaders)
 	{
 		if (!m_shaders.count(shaderName))
+		{
+			fprintf(stderr, "ERROR: program %s needs missing shader: %s \n", name.c_str(), shaderName.c_str());
 			return false;
+		}
 
-		GLuint shader = m_shaders[shaderName];
-
-		glAttachShader(program,shader);
+		ids.push_back(m_shaders[shaderName]);
 	}
 
-	glLinkProgram(program);
-	GLint success = 0;
-	glGetShaderiv(program, GL_LINK_STATUS, &success);
-
-	GLint length = 0;
-	glGetShaderiv(program, GL_INFO_LOG_LENGTH, &length);
-
-	if (length && success == GL_FALSE) 
-	{	
-		std::vector<GLchar> error_message(length);
-		glGetShaderInfoLog(program, length, NULL, &error_message[0]);
+	GLuint program = linkProgram(ids);
 
-		if (length)
-			printf("%s", &error_message[0]);
-		return false;
-	}
-	else 
+	if (!program)
 	{
-		m_programs[name] = {program};
-		return true;
+		fprintf(stderr, "ERROR: could not link program: %s \n", name.c_str());
+		return false;
 	}
+
+	m_programs[name] = {program};
+	m_programShaders[name] = shaders;
+	return true;
 }
 
 ShaderProgram& ShaderManager::program(const std::string& name)
@@ -180,6 +283,82 @@ ShaderProgram& ShaderManager::program(const std::string& name)
 		throw std::runtime_error("Program does not exist:" + name + "\n");
 }
 
+ShaderProgram& ShaderManager::program(const std::string& name, const ShaderDefines& defines)
+{
+	if (defines.empty())
+		return program(name);
+
+	std::string key = variantKey(name, defines);
+
+	if (m_programs.count(key))
+		return m_programs[key];
+
+	// A variant that fails is kept as an invalid program, so it is reported
+	// once and its callers can fall back rather than stop.
+	if (!m_programShaders.count(name))
+	{
+		fprintf(stderr, "ERROR: program does not exist: %s \n", name.c_str());
+		return m_programs[key] = {0};
+	}
+
+	std::vector<GLuint> ids;
+
+	for (auto& shaderName : m_programShaders[name])
+	{
+		std::string shaderKey = variantKey(shaderName, defines);
+
+		if (!m_shaders.count(shaderKey))
+		{
+			const ShaderSource& source = m_sources[shaderName];
+			std::string text = injectDefines(source.text, defines);
+
+			GLuint shader = compileShader(source.type, text.c_str());
+			if (!shader)
+			{
+				fprintf(stderr, "ERROR: could not compile variant: %s \n", shaderKey.c_str());
+				return m_programs[key] = {0};
+			}
+
+			m_shaders[shaderKey] = shader;
+		}
+		ids.push_back(m_shaders[shaderKey]);
+	}
+
+	GLuint id = linkProgram(ids);
+	if (!id)
+		fprintf(stderr, "ERROR: could not link variant: %s \n", key.c_str());
+
+	return m_programs[key] = {id};
+}
+
+GLuint ShaderManager::linkProgram(const std::vector<GLuint>& shaders)
+{
+	GLuint program = glCreateProgram();
+
+	for (GLuint shader : shaders)
+		glAttachShader(program,shader);
+
+	glLinkProgram(program);
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+	if (success == GL_FALSE) 
+	{	
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+
+		std::vector<GLchar> error_message(length + 1);
+		glGetProgramInfoLog(program, length, NULL, &error_message[0]);
+
+		if (length)
+			printf("%s", &error_message[0]);
+
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
 GLuint ShaderManager::compileShader(GLenum type, const char* source)
 {
 	GLuint s = glCreateShader(type);
@@ -0,0 +1,47 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+
+/**********************************************************************************
+ *
+ * Offline rendering of a frame range.  The coordinator forks worker processes,
+ * each with its own headless GL context (see createHeadlessContext), so no
+ * display server is needed.  Workers claim frames one at a time from a
+ * counter in shared memory, so faster workers simply take more frames.
+ * Every frame is evaluated at its own absolute time (see AnimationTimeline)
+ * and written as out/frame_NNNNNN.ppm.  A worker that cannot set up its
+ * context or scene, or write a frame, makes the whole batch fail.
+ *
+ **********************************************************************************/
+
+struct BatchOptions
+{
+    int firstFrame = 0;
+    int lastFrame = 0;          // Inclusive
+    double fps = 60;
+    int workers = 0;            // 0 uses the hardware concurrency
+    int width = 1920;
+    int height = 1080;
+    float animSpeed = 0.25f;    // Revolutions per second
+    int sampling = 0;           // SphereSampling
+    float curl = 0;
+    bool fiberMotion = false;   // Move fibers in S3 instead of regenerating them each frame
+    bool software = false;      // Ask Mesa for its software rasterizer
+    std::string outputDir = "frames";
+    std::string shaderDir = "../graphics/shader/";
+};
+
+/**
+ * Parse batch options from the command line.  Returns false and prints usage
+ * on unknown or malformed arguments.
+ */
+extern bool parseBatchOptions(int argc, char** argv, BatchOptions& options);
+
+/**
+ * Render options.firstFrame..options.lastFrame.  Must be called before GLFW
+ * is initialised in this process.  Returns a process exit code.
+ */
+extern int runBatchRender(const BatchOptions& options);
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "defines.h"
+#include "mesh.h"
+
+/**********************************************************************************
+ * 
+ * CPU fiber generation.  Mirrors the math in hopf.comp so results can be
+ * produced and checked without a GL context.
+ * 
+ **********************************************************************************/
+
+/**
+* Projected Hopf fiber over a point of S2.  Stereographic projection maps the
+* fiber (a great circle of S3) to a circle in R3, or to a line when the fiber
+* passes through the projection pole.
+* 
+* For a circle, points are center + radius*(cos(t)*axis + sin(t)*binormal)
+* and normal is the plane normal.  For the line, center is the point closest
+* to the origin and axis is the direction; radius is infinite.
+*/
+template<typename T>
+struct FiberCircle
+{
+    glm::vec<3,T> center;
+    glm::vec<3,T> normal;
+    glm::vec<3,T> axis;
+    glm::vec<3,T> binormal;
+    T radius;
+    bool isLine;
+
+    glm::vec<3,T> point(T t) const
+    {
+        if (isLine)
+            return center + std::tan(t/2)*axis;
+        return center + radius*(std::cos(t)*axis + std::sin(t)*binormal);
+    }
+};
+
+/**
+* Closed-form circle for the fiber over p, using the same axis order as
+* hopf.comp.  Exact up to rounding; there is no numerical fitting, so it
+* stays accurate for fibers near the projection pole.
+* 
+* @param p - Point on S2.
+*/
+template<typename T>
+FiberCircle<T> fiberCircle(glm::vec<3,T> p);
+
+/**
+* Batch form of fiberCircle.
+*/
+template<typename T>
+void fiberCircles(const glm::vec<3,T>* points, size_t count, FiberCircle<T>* out);
+
+/**
+* Point on the Hopf fiber over a point of S2, as a unit vector in R4.  The
+* components of p are used in the order (a,b,c) = (p.x,p.y,p.z); hopf.comp
+* and fiberCircle pass (p.z,p.y,p.x).
+* 
+* @param p - Point on S2.
+* @param t - Fiber parameter in radians.
+*/
+template<typename T>
+static inline glm::vec<4,T> hopfFiber(glm::vec<3,T> p, T t)
+{
+    // r1*r2 = |(p.y,p.z)|/2 avoids cancellation in 1 + p.x near p.x = -1.
+    T rho = std::sqrt(p.y*p.y + p.z*p.z);
+    T r2 = std::sqrt((1 - p.x)/2);
+    T r1 = p.x >= 0 ? std::sqrt((1 + p.x)/2) : rho/(2*r2);
+    T theta2 = std::atan2(-p.z,p.y);
+
+    return glm::vec<4,T>(
+        r1*std::cos(t),
+        r1*std::sin(t),
+        r2*std::cos(theta2 - t),
+        r2*std::sin(theta2 - t)
+    );
+}
+
+/**
+* Stereographic projection from S3 to R3 through (0,0,0,1).
+*/
+template<typename T>
+static inline glm::vec<3,T> stereographic(glm::vec<4,T> v)
+{
+    return glm::vec<3,T>(v)/(1 - v.w);
+}
+
+/**
+* Inverse of stereographic: the point of S3 that projects to p.
+*/
+template<typename T>
+static inline glm::vec<4,T> inverseStereographic(glm::vec<3,T> p)
+{
+    T s = glm::dot(p,p);
+    return glm::vec<4,T>(T(2)*p, s - 1)/(s + 1);
+}
+
+/**
+* Isometry of S3 that carries the fiber over each p to the fiber over
+* rotation*p, as a matrix acting on the points that stereographic projects
+* (those of hopfFiber over (p.z,p.y,p.x)).  Conjugated by stereographic
+* projection it is a Mobius transformation of R3 that moves every projected
+* fiber onto the rotated one, so fibers generated once can follow a rotation
+* of their base points without being regenerated.
+* 
+* @param rotation - Rotation of S2.
+*/
+template<typename T>
+glm::mat<4,4,T> fiberMotion(const glm::mat<3,3,T>& rotation);
+
+/**
+* Sample the projected fiber over each base point, writing fiberRes vertices
+* per fiber to out (fiberCount*fiberRes in total).
+* 
+* @param basePoints - Points on S2, one per fiber.
+* @param fiberCount - Number of base points.
+* @param fiberRes - Number of samples in each fiber.
+* @param out - Output vertices.
+*/
+extern void sampleFibers(const vec3* basePoints, size_t fiberCount, uint fiberRes, Vertex* out);
+
+/**********************************************************************************
+ * 
+ * Fiber surfaces.  The fibers over a closed curve on S2 sweep out a surface,
+ * a Hopf torus when the curve is simple, which is meshed directly instead of
+ * as separate tubes.
+ * 
+ **********************************************************************************/
+
+/**
+* Accuracy and limits of the mesh made by hopfSurface.
+*/
+struct HopfSurfaceOptions
+{
+    float tolerance = 1e-3f;        // Largest distance between the mesh and the surface
+    float maxRadius = 50;           // Fibers larger than this are left out
+    uint  minCurveSegments = 32;    // Fibers along the curve
+    uint  maxCurveSegments = 4096;
+    uint  minFiberSegments = 16;    // Segments around each fiber
+    uint  maxFiberSegments = 1024;
+};
+
+/**
+* Mesh the projected preimage of a closed curve on S2 as a closed triangle
+* mesh, adapting the resolution in both directions.  Along the curve,
+* intervals are split until the fiber over each midpoint lies within
+* tolerance of the average of the fibers at its ends.  Around each fiber, the
+* segment count keeps the chords within tolerance of the circle, rounded up
+* to a power of two so that neighbouring rings mostly share parameters; rings
+* of different counts are stitched by parameter.  Fibers through or near the
+* projection pole leave an open gap.
+* 
+* Normals are exact around the fibers and finite differences along the
+* curve.  Vertices are coloured by their base point.
+* 
+* @param curve - Curve on S2, periodic over [0,1].
+* @param options - Tolerance and resolution limits.
+* @param vertices - Output vertices, replaced.
+* @param indices - Output triangle list, replaced.
+*/
+extern void hopfSurface(const std::function<vec3(float)>& curve, const HopfSurfaceOptions& options,
+    std::vector<Vertex>& vertices, std::vector<uint>& indices);
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef FIBERBVH_H
+#define FIBERBVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "defines.h"
+#include "fiber.h"
+
+/**********************************************************************************
+ *
+ * Bounding volume hierarchies over fibers, for queries on the CPU.  FiberBVH
+ * holds tube segments, for exact hits in offline rendering; FiberIndex holds
+ * whole fibers, for picking and range queries on large fiber counts.
+ *
+ **********************************************************************************/
+
+// Segment index of a ray that hit nothing.
+#define FIBER_BVH_MISS UINT32_MAX
+
+// Rays traced together by the packet form of FiberBVH::intersect.
+#define RAY_PACKET_SIZE 8
+
+struct FiberSegment
+{
+    vec3 a;
+    vec3 b;
+    float radius;
+    uint32_t fiber;
+};
+
+struct Ray
+{
+    vec3 origin;
+    vec3 dir;               // Normalized
+    float tMax;             // Hits further along are ignored
+};
+
+struct RayHit
+{
+    float t = 0;
+    uint32_t segment = FIBER_BVH_MISS;
+};
+
+/**
+ * Rays stored component by component, so one node test covers every ray
+ * with the same instructions.  Meant for coherent rays, such as neighbouring
+ * primary rays.
+ */
+struct RayPacket
+{
+    float origin[3][RAY_PACKET_SIZE];
+    float dir[3][RAY_PACKET_SIZE];
+    float tMax[RAY_PACKET_SIZE];            // In: far limit.  Out: distance to the hit
+    uint32_t segment[RAY_PACKET_SIZE];      // Out: FIBER_BVH_MISS if nothing was hit
+
+    void set(int lane, const Ray& ray);
+};
+
+/**
+ * Capsules between consecutive samples of the projected fiber over each base
+ * point, fiberRes per fiber.  Fibers through the projection pole are lines
+ * and are left out.
+ *
+ * @param basePoints - Points on S2, one per fiber.
+ * @param fiberRes - Samples per fiber.
+ * @param radius - Tube radius.
+ */
+extern std::vector<FiberSegment> fiberSegments(const std::vector<vec3>& basePoints, uint fiberRes, float radius);
+
+/**
+ * Node of either hierarchy.  Children of an inner node are stored depth
+ * first: the first directly after it, the second at offset.
+ */
+struct BVHNode
+{
+    vec3 lo;
+    uint32_t offset;    // First item of a leaf, or second child
+    vec3 hi;
+    uint16_t count;     // Items in a leaf; 0 for inner nodes
+    uint16_t axis;      // Split axis of an inner node
+};
+
+/**
+ * Tube segments, intersected exactly: segments are the capsules
+ * fiber_impostor.frag ray casts.
+ */
+class FiberBVH
+{
+public:
+    /**
+     * Build over segments with a binned surface area heuristic.  The
+     * segments are reordered; use segment() to look them up by hit.
+     */
+    void build(std::vector<FiberSegment> segments);
+
+    /**
+     * Nearest hit along ray.  Returns false on a miss.
+     */
+    bool intersect(const Ray& ray, RayHit& hit) const;
+
+    /**
+     * Nearest hit for each ray of packet.  Nodes are visited once for the
+     * whole packet, in the order of its first ray.
+     */
+    void intersect(RayPacket& packet) const;
+
+    /**
+     * Whether anything lies along ray before ray.tMax.  Stops at the first
+     * hit, so it is cheaper than intersect.
+     */
+    bool occluded(const Ray& ray) const;
+
+    /**
+     * Outward unit normal of the tube of a hit segment at point p.
+     */
+    vec3 normal(uint32_t segment, vec3 p) const;
+
+    const FiberSegment& segment(uint32_t segment) const {return m_segments[segment];}
+    size_t segmentCount() const {return m_segments.size();}
+    size_t nodeCount() const {return m_nodes.size();}
+    bool empty() const {return m_segments.empty();}
+
+private:
+    std::vector<BVHNode> m_nodes;
+    std::vector<FiberSegment> m_segments;
+};
+
+/**
+ * Whole fibers, each bounded arc by arc with its tube.  Queries test the
+ * circles themselves, so results are exact, and each fiber is reported
+ * once.  Moving the fibers refits the bounds in place and rebuilds only once
+ * the tree has grown too loose.
+ *
+ * Fibers through the projection pole are lines, which no box bounds; the
+ * few there are at a time are tested one by one.
+ */
+class FiberIndex
+{
+public:
+    /**
+     * @param basePoints - Points on S2, one per fiber.
+     * @param radius - Tube radius.
+     */
+    void build(const std::vector<vec3>& basePoints, float radius);
+
+    /**
+     * Move the fibers to new base points, one per fiber as built.
+     */
+    void update(const std::vector<vec3>& basePoints);
+
+    /**
+     * Fiber whose tube ray hits first, or FIBER_BVH_MISS.
+     *
+     * @param t - Set to the distance along ray to the hit.
+     */
+    uint32_t pick(const Ray& ray, float& t) const;
+
+    /**
+     * Fiber closest to p, or FIBER_BVH_MISS if none is within maxDistance.
+     *
+     * @param distance - Set to the distance from p to that fiber.
+     */
+    uint32_t nearest(vec3 p, float maxDistance, float& distance) const;
+
+    /**
+     * Append to fibers every fiber that passes through the box [lo,hi].
+     */
+    void queryBox(vec3 lo, vec3 hi, std::vector<uint32_t>& fibers) const;
+
+    /**
+     * Append to fibers every fiber that comes within radius of center.
+     */
+    void querySphere(vec3 center, float radius, std::vector<uint32_t>& fibers) const;
+
+    const FiberCircle<float>& circle(uint32_t fiber) const {return m_circles[fiber];}
+    size_t fiberCount() const {return m_circles.size();}
+    size_t nodeCount() const {return m_nodes.size();}
+
+private:
+    /**
+     * Circles of every fiber, bounds of every arc, and the list of lines.
+     */
+    void setFibers(const std::vector<vec3>& basePoints);
+    void refit();
+    float treeArea() const;
+
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_order;      // Arc of each leaf item; arcs of a fiber are consecutive
+    std::vector<FiberCircle<float>> m_circles;
+    std::vector<vec3> m_lo;             // Bounds of each arc
+    std::vector<vec3> m_hi;
+    std::vector<uint32_t> m_lines;
+    float m_radius = 0;
+    float m_builtArea = 0;              // treeArea() when last built
+};
+
+#endif
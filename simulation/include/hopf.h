@@ -4,14 +4,29 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "autotune.h"
+#include "gpuarena.h"
 #include "mesh.h"
 #include "renderer.h"
+#include "rendergraph.h"
 #include "defines.h"
 #include "shader.h"
 
 
+/**
+ * Link every program used by SphereController and HopfFibrationDisplay. The
+ * shader manager must already have compiled the shader directory.  Returns
+ * false if any program is missing a shader or fails to link.
+ */
+extern bool addHopfPrograms(ShaderManager& shaderManager);
+
 /**********************************************************************************
  * 
  * Control sphere manager
@@ -24,6 +39,16 @@ struct SpherePointData
     vec4 color;
 };
 
+/**
+ * How the fiber tubes are drawn.
+ */
+enum FiberTubeMode
+{
+    TUBES_MESH = 0,     // Tessellated tubes, lineDetail vertices per ring
+    TUBES_IMPOSTOR,     // Ray-cast capsules, see fiber_impostor.vert
+    TUBES_LINES         // Anti-aliased screen-space lines, see fiber_lines.vert
+};
+
 struct SimulationParams
 {
     float animSpeed;
@@ -32,25 +57,93 @@ struct SimulationParams
     int   lineDetail = 8;
     bool  drawMesh;
     bool  drawLines;
+    int   sampling = 0;   // SphereSampling
+    bool  fusedFibers = true;   // Generate each fiber in one workgroup, see fiber_fused.comp
+    int   tubeMode = TUBES_MESH;    // FiberTubeMode
+    bool  pointImpostors = true;    // Ray-cast the control points, see sphere_impostor.vert
+    bool  fiberMotion = false;      // Move fibers in S3 rather than regenerate them, see fiber_motion.glsl
+    bool  drawSurface = false;      // Mesh of the fibers over the surface curve, see hopfSurface
+    float surfaceTolerance = 1e-3f; // Largest distance between that mesh and the unrotated surface
+
+    // TUBES_LINES only
+    float lineWidth = 1.5f;     // In output pixels
+    float lineAlpha = 1.0f;
+    bool  lineAdditive = false; // Add up overlapping lines, for a density look
+    float pixelScale = 1.0f;    // Render target pixels per output pixel, e.g. when supersampling
 };
+
+// Where tuned work group sizes are kept, relative to the working directory.
+#define HOPF_TUNING_FILE "hopf_tuning.txt"
+
+// Longest fiber fiber_fused.comp is built for.  Its three shared arrays of
+// vec3 must fit in the 32 KB of shared memory every GL 4.3 device has.
+#define FUSED_MAX_SAMPLES 512
+
+// Copies of the fiber geometry.  Fibers are regenerated into one copy while
+// draws from the other may still be in flight.
+#define FIBER_GEOMETRY_SETS 2
+
+// Tube around the fiber outlined by HopfFibrationDisplay::highlightFiber.
+#define HIGHLIGHT_SEGMENTS 256
+#define HIGHLIGHT_SIDES 8
+#define HIGHLIGHT_RADIUS 0.03f      // Fiber tubes are 0.02
+
+// Samples per side of the grid the control sphere mesh is evaluated on.
+#define SPHERE_MESH_RES 64
+
 class SphereController
 {
 public:
+    /**
+     * @param arena - Where the point buffers are allocated.
+     */
     SphereController(
         std::shared_ptr<ShaderManager>& shaderManager, 
-        std::shared_ptr<SimulationParams>& params);
+        std::shared_ptr<SimulationParams>& params,
+        std::shared_ptr<GpuArena>& arena);
 
-    void updateBallPositions();
+    /**
+     * Rotate the base points into the points buffer.  Does nothing and
+     * returns false if the rotation is the one already applied.
+     * 
+     * @param rotation - Rotation at the current time, see AnimationTimeline.
+     */
+    bool updateBallPositions(const mat3& rotation);
     void render(Camera& camera);
     void transform(mat4 trans);
     const Buffer& getPoints() {return m_points;}
-    void uploadPointData(void* data, size_t size);
+    const Buffer& getBasePoints() {return m_basePoints;}
+    void uploadPointData(const void* data, size_t size);
+
+    /**
+     * Replace the base points, uploading only the runs that changed and
+     * transforming only those.  Returns the indices of the changed points,
+     * which is all of them when the point count changes.
+     */
+    std::vector<uint> updatePointData(const std::vector<SpherePointData>& points);
+
+    /**
+     * Draw one point enlarged and in white, or none if point is -1.
+     */
+    void setHighlight(int point) {m_highlight = point;}
 
 private:
+    void transformPoints(uint first, uint count);
+    void buildSphereMesh();
+
+    // Declared first so it outlives the buffers allocated from it.
+    std::shared_ptr<GpuArena> m_arena;
+
     Buffer m_points;
+    Buffer m_basePoints;
+    std::vector<SpherePointData> m_basePointData;
+    mat3 m_rotation = mat3(1.0f);
     Mesh m_sphereMesh;
+    MeshGen m_meshGen;
+    GLVertexArray m_emptyVao;   // For impostor draws, which fetch no attributes
     Camera m_camera;
     mat4 m_geometry = mat4(1.0f);
+    int m_highlight = -1;
 
     int pointCount;
 
@@ -60,21 +153,221 @@ private:
 class HopfFibrationDisplay
 {
 public:
+    /**
+     * @param arena - Where the fiber buffers and per-update transients are
+     *                allocated.
+     */
     HopfFibrationDisplay(
         std::shared_ptr<ShaderManager>& shaderManager, 
-        std::shared_ptr<SimulationParams>& params);
+        std::shared_ptr<SimulationParams>& params,
+        std::shared_ptr<GpuArena>& arena);
+    ~HopfFibrationDisplay();
 
     void updateIndexData(const uint fiberCount, const uint fiberRes);
+
+    /**
+     * Regenerate a fiber on the next updateFiberData.  Its neighbours are
+     * marked too, since their mesh normals depend on it.
+     */
+    void markFiberDirty(uint fiber);
+    void markAllDirty();
+
+    /**
+     * Regenerate the dirty fibers into the geometry set not drawn last, which
+     * then becomes the one drawn.  When only some are dirty, the dirty bits
+     * are compacted into a fiber list on the GPU and every pass is dispatched
+     * indirectly over that list, so the cost scales with the number of dirty
+     * fibers rather than the total.  Passes for geometry that is not drawn
+     * are culled.
+     */
     void updateFiberData();
+
+    /**
+     * Draw the current geometry set and fence it, so the next update into it
+     * waits for these draws on the GPU rather than serialising with them.
+     * Unless tubeMode is TUBES_MESH, tubes are drawn straight from the
+     * fiber samples, and the tube mesh is neither generated nor drawn.
+     */
     void render(Camera& camera);
 
-    void setPoints(const Buffer& points);
+    /**
+     * @param points - Rotated base points, see SphereController.
+     * @param basePoints - The same points before rotation.
+     */
+    void setPoints(const Buffer& points, const Buffer& basePoints);
+
+    /**
+     * Rotation of the base points.  Fibers are normally generated over the
+     * rotated points, so a new rotation marks them all dirty.  With
+     * fiberMotion they are generated once over the unrotated points, and the
+     * matching isometry of S3 (see fiberMotion in fiber.h) is applied as
+     * they are drawn; a new rotation then costs nothing but a uniform.  Tube
+     * meshes are moved conformally, so they thicken where fibers grow, while
+     * impostors and lines keep their width.
+     */
+    void setRotation(const mat3& rotation);
+
+    /**
+     * Curve on S2 whose fibers make the surface drawn when drawSurface is
+     * set, periodic over [0,1], before rotation.  The surface is meshed on
+     * the CPU by hopfSurface, only while it is drawn, and again on the next
+     * updateFiberData after the curve or tolerance change.  The mesh is
+     * always built over the unrotated curve and moved in S3 as it is drawn,
+     * whatever fiberMotion, so rotating never remeshes it.
+     */
+    void setSurfaceCurve(std::function<vec3(float)> curve);
+
+    /**
+     * Outline the fiber over point, a rotated base point, with a white tube
+     * a little wider than the fibers'.  The tube is built on the CPU from
+     * the fiber's circle, so it needs nothing read back from the GPU and
+     * shows whatever the tube mode.  Fibers through the projection pole
+     * are lines and are not outlined.
+     */
+    void highlightFiber(vec3 point);
+    void clearHighlight() {m_highlighted = false;}
+
+    size_t surfaceVertexCount() const {return m_surfaceVertices;}
+    size_t surfaceTriangleCount() const {return m_surfaceIndices/3;}
+
+    /**
+     * Time candidate local sizes for the fiber kernels at the current fiber
+     * count and detail, record the fastest in tuner and switch to them.
+     * Overwrites the generated geometry, which is rebuilt on the next update.
+     */
+    void autotune(WorkGroupTuner& tuner);
+
+    /**
+     * Switch to the local sizes tuner has recorded for the current
+     * configuration.  Kernels never tuned keep the sizes in their source.
+     */
+    void applyTuning(const WorkGroupTuner& tuner);
+
+    /**
+     * Passes, culled passes and barriers of the last fiber update.
+     */
+    const RenderGraphStats& graphStats() const {return m_graph.lastStats();}
 private:
+    /**
+     * drawMesh, unless the sampling leaves consecutive fibers apart, where
+     * the mesh would join unrelated fibers across the scene.
+     */
+    bool drawCircleMesh() const;
+
+    struct FiberGeometry
+    {
+        PrimitiveData<Vertex> circleData;
+        PrimitiveData<Vertex> lineMeshData;
+
+        // Fibers that are stale in this set; words in [dirtyBegin, dirtyEnd)
+        // may be set.
+        std::vector<uint32_t> dirtyBits;
+        size_t dirtyBegin = 0;
+        size_t dirtyEnd = 0;
+        bool allDirty = true;
+
+        // Geometry generated at the last update.  Passes for the rest may
+        // have been culled, leaving it stale.
+        bool hasCircles = false;
+        bool hasTubes = false;
+
+        bool has(bool circles, bool tubes) const {return (hasCircles || !circles) && (hasTubes || !tubes);}
+
+        // Signalled once the last draws from this set have completed.
+        GLsync drawFence = 0;
+    };
+
+    /**
+     * Allocate the tube mesh of geometry for the current lineDetail, unless
+     * it is already big enough.
+     */
+    void reserveTubeMesh(FiberGeometry& geometry);
+
+    /**
+     * Generate the fibers into geometry, or only those in the compacted list
+     * if partial is set.  Passes not needed for the requested circles and
+     * tubes are culled.
+     */
+    void runFiberPasses(FiberGeometry& geometry, bool partial, bool circles, bool tubes);
+
+    /**
+     * Regenerate the surface mesh from the unrotated surface curve.
+     */
+    void updateSurface();
+
+    /**
+     * Rebuild the highlight tube around the fiber over m_highlightPoint.
+     */
+    void updateHighlight();
+
+    /**
+     * Point the fiber_motion.glsl uniforms of program at the current
+     * rotation, or turn the motion off.
+     */
+    void setMotionUniforms(ShaderProgram& program, bool moving);
+
+    /**
+     * Draw the tubes of geometry as capsule impostors or as lines.  Both
+     * read the samples and instances as storage buffers.
+     */
+    void bindSamples(FiberGeometry& geometry);
+    void renderImpostors(Camera& camera, FiberGeometry& geometry);
+    void renderLines(FiberGeometry& geometry);
+
+    /**
+     * Upload the dirty bits of geometry and compact them into a transient
+     * fiber list, returned for the fiber passes to read.  The per-line
+     * command is sized for fiber_fused if fused is set.
+     */
+    RGResource addCompactPasses(RenderGraph& graph, FiberGeometry& geometry, bool fused);
+
+    /**
+     * Variant of a fiber kernel with the tuned local size, the current line
+     * detail and any extra defines.
+     */
+    ShaderProgram& kernel(const std::string& name, const ShaderDefines& extra = {});
+    std::string tuningConfig() const;
+
+    // Declared first so it outlives the buffers allocated from it.
+    std::shared_ptr<GpuArena> m_arena;
+
     const Buffer* spherePoints;
+    const Buffer* baseSpherePoints;
+
+    mat3 m_rotation = mat3(1.0f);
+    mat4 m_motion = mat4(1.0f);     // fiberMotion(m_rotation)
+    bool m_moving = false;          // fiberMotion when the fibers were marked
+    bool m_meshNormals = false;     // drawCircleMesh() when the fibers were marked
     Buffer lineInstances;
-    Buffer frameData;
-    PrimitiveData<Vertex> circleData;
-    PrimitiveData<Vertex> lineMeshData;
+
+    FiberGeometry m_geometry[FIBER_GEOMETRY_SETS];
+    uint m_front = 0;   // Set drawn by render
+
+    // GPU copy of the dirty bits of the set being updated.
+    Buffer dirtyBits;
+
+    // Rebuilt for every update; its transients come from m_arena.
+    RenderGraph m_graph;
+
+    // Impostors and lines fetch everything from storage buffers, but a draw
+    // still needs a vertex array bound.
+    GLVertexArray m_emptyVao;
+
+    PrimitiveData<Vertex> m_surface;
+    std::function<vec3(float)> m_surfaceCurve;
+    float m_surfaceTolerance = 0;   // Tolerance of the current mesh
+    bool m_surfaceDirty = true;
+    size_t m_surfaceVertices = 0;
+    size_t m_surfaceIndices = 0;
+
+    PrimitiveData<Vertex> m_highlight;
+    vec3 m_highlightPoint = vec3(0);
+    bool m_highlighted = false;
+    bool m_highlightDirty = false;
+    size_t m_highlightIndices = 0;
+
+    // Tuned LOCAL_SIZE_* defines, per tuning group.
+    std::unordered_map<std::string, ShaderDefines> m_localSizes;
 
     std::shared_ptr<SimulationParams> m_params;
     std::shared_ptr<ShaderManager> m_shaderManager;
@@ -0,0 +1,122 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "defines.h"
+#include "hopf.h"
+#include "shader.h"
+
+/**********************************************************************************
+ *
+ * Rendering without a visible window, shared by the batch and poster modes.
+ *
+ **********************************************************************************/
+
+/**
+ * GL context with no window, current on the calling thread.
+ */
+struct HeadlessContext;
+
+/**
+ * Make a headless context current.  On Linux it is a surfaceless EGL
+ * context, which needs no X or Wayland display; on Windows, a hidden GLFW
+ * window.  Returns nullptr on failure.
+ *
+ * @param software - Ask Mesa for its software rasterizer.
+ */
+extern HeadlessContext* createHeadlessContext(bool software);
+extern void destroyHeadlessContext(HeadlessContext* context);
+
+/**
+ * Framebuffer with RGBA8 color and 24 bit depth renderbuffers.
+ */
+class OffscreenTarget
+{
+public:
+    OffscreenTarget() {}
+    ~OffscreenTarget();
+
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+    /**
+     * (Re)allocate storage.  Returns false if the framebuffer is incomplete,
+     * e.g. when the size exceeds GL_MAX_RENDERBUFFER_SIZE.
+     */
+    bool create(int width, int height);
+
+    /**
+     * Bind for drawing and set the viewport to the whole target.
+     */
+    void bind();
+
+    /**
+     * Read the color buffer as tightly packed RGB, bottom row first.
+     */
+    void readPixels(std::vector<unsigned char>& rgb) {readPixels(rgb, m_width, m_height);}
+
+    /**
+     * Read only the bottom left width x height pixels.
+     */
+    void readPixels(std::vector<unsigned char>& rgb, int width, int height);
+
+    int width() const {return m_width;}
+    int height() const {return m_height;}
+
+private:
+    GLuint m_framebuffer = 0;
+    GLuint m_renderbuffers[2] = {0, 0};
+    int m_width = 0;
+    int m_height = 0;
+};
+
+/**
+ * The fibration scene as seen from the interactive scene viewport.
+ */
+class OffscreenScene
+{
+public:
+    OffscreenScene(const std::string& shaderDir, int sampling, float curl, int width, int height);
+
+    /**
+     * Move the control points and regenerate the fibers.
+     *
+     * @param rotation - See AnimationTimeline::sphereRotation.
+     */
+    void update(const mat3& rotation);
+
+    /**
+     * Draw into the bound framebuffer.
+     */
+    void render();
+
+    /**
+     * Drawing parameters, to adjust before the first update().
+     */
+    SimulationParams& params() {return *m_params;}
+
+    /**
+     * Whether every program linked.  Nothing should be rendered otherwise.
+     */
+    bool ready() const {return m_ready;}
+
+    Camera camera;
+
+private:
+    std::shared_ptr<ShaderManager> m_shaderManager;
+    std::shared_ptr<SimulationParams> m_params;
+    std::shared_ptr<GpuArena> m_arena;
+
+    SphereController m_controller;
+    HopfFibrationDisplay m_display;
+    bool m_ready = false;
+};
+
+#endif
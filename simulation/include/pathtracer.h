@@ -0,0 +1,48 @@
+#ifndef PATHTRACER_H
+#define PATHTRACER_H
+
+#include <string>
+
+/**********************************************************************************
+ *
+ * Path traced stills on the CPU, for machines without a GPU.  Fiber tubes are
+ * intersected exactly through a FiberBVH, lit by a sky and a sun of finite
+ * size, so shadows are soft and creases darken by occlusion.  The image is
+ * cut into tiles shared out to worker threads, which steal from each other
+ * when they run dry.  Every pass adds one sample per pixel, and the image is
+ * saved as it refines.
+ *
+ * The view is set up by the same Camera as the raster OffscreenScene.
+ *
+ **********************************************************************************/
+
+struct TraceOptions
+{
+    int width = 1920;
+    int height = 1080;
+    int passes = 64;            // Samples per pixel, one per pass
+    int bounces = 3;            // Diffuse bounces; sky light needs at least one
+    int threads = 0;            // 0 for one per hardware thread
+    int tileSize = 16;          // Pixels per tile side
+    int saveEvery = 8;          // Passes between saves of the image so far; 0 saves only at the end
+    double time = 0;            // Animation time in seconds
+    float animSpeed = 0.25f;    // Revolutions per second
+    int sampling = 0;           // SphereSampling
+    float curl = 0;
+    float tubeRadius = 0.02f;   // As drawn by the raster path
+    float sunSize = 2.0f;       // Angular radius of the sun in degrees; sets shadow softness
+    std::string output = "trace.ppm";
+};
+
+/**
+ * Parse trace options from the command line.  Returns false and prints
+ * usage on unknown or malformed arguments.
+ */
+extern bool parseTraceOptions(int argc, char** argv, TraceOptions& options);
+
+/**
+ * Render the image.  Returns a process exit code.
+ */
+extern int runTraceRender(const TraceOptions& options);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef POSTER_H
+#define POSTER_H
+
+#include <string>
+
+/**********************************************************************************
+ *
+ * Tiled rendering of a single large image.  The view is cut into tiles, each
+ * rendered through an off-center sub-frustum (see Camera::setSubFrustum) into
+ * a small framebuffer, optionally supersampled, and written straight into
+ * its place in a PPM file.  Memory use depends only on the tile size.
+ *
+ **********************************************************************************/
+
+struct PosterOptions
+{
+    int width = 16384;
+    int height = 16384;
+    int tileSize = 2048;        // Output pixels per tile side
+    int supersample = 1;        // Samples per output pixel along each axis
+    double time = 0;            // Animation time in seconds
+    float animSpeed = 0.25f;    // Revolutions per second
+    int sampling = 0;           // SphereSampling
+    float curl = 0;
+    float lineWidth = 0;        // If set, draw fibers as lines this many pixels wide
+    bool additive = false;      // Add up overlapping lines
+    bool noMesh = false;        // Leave out the circle mesh, which only path sampling has anyway
+    bool surface = false;       // Draw the surface over the path, see hopfSurface
+    bool software = false;
+    std::string output = "poster.ppm";
+    std::string shaderDir = "../graphics/shader/";
+};
+
+/**
+ * Parse poster options from the command line.  Returns false and prints
+ * usage on unknown or malformed arguments.
+ */
+extern bool parsePosterOptions(int argc, char** argv, PosterOptions& options);
+
+/**
+ * Render the poster.  Returns a process exit code.
+ */
+extern int runPosterRender(const PosterOptions& options);
+
+#endif
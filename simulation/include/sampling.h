@@ -0,0 +1,104 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "defines.h"
+
+/**********************************************************************************
+ * 
+ * Sampling of base points on S2.  All generators run in parallel over
+ * `threads` workers (0 picks the hardware concurrency) and are deterministic
+ * for a given thread count.
+ * 
+ **********************************************************************************/
+
+enum SphereSampling
+{
+    SAMPLING_PATH = 0,       // Points along a single curve (see sampleBasePoints)
+    SAMPLING_FIBONACCI,      // Fibonacci lattice
+    SAMPLING_EQUAL_AREA,     // Centers of HEALPix-style equal-area cells
+    SAMPLING_LATITUDE_BANDS  // Stratified samples in equal-area latitude bands
+};
+
+/**
+ * Region of S2 bounded by polar angle theta in [thetaMin, thetaMax] and
+ * azimuth phi in [phiMin, phiMax], in radians.  The default is the whole
+ * sphere.
+ */
+struct SphereRegion
+{
+    float thetaMin = 0;
+    float thetaMax = PI;
+    float phiMin = 0;
+    float phiMax = 2*PI;
+
+    bool contains(float theta, float phi) const;
+    float area() const;
+};
+
+/**
+ * Fibonacci lattice with exactly count points, uniformly spread over the
+ * region.
+ */
+extern std::vector<vec3> sampleFibonacci(size_t count, const SphereRegion& region = {}, unsigned threads = 0);
+
+/**
+ * Centers of the HEALPix cells at resolution nside that fall inside the
+ * region. The full sphere has 12*nside*nside cells of equal area.
+ */
+extern std::vector<vec3> sampleEqualArea(size_t nside, const SphereRegion& region = {}, unsigned threads = 0);
+
+/**
+ * Smallest HEALPix resolution with at least count cells inside the region.
+ */
+extern size_t equalAreaResolution(size_t count, const SphereRegion& region = {});
+
+/**
+ * Stratified sampling with exactly count points.  The region is cut into
+ * latitude bands of equal area, each band into cells of equal area, and one
+ * point is placed per cell, either at its center or jittered inside it.
+ */
+extern std::vector<vec3> sampleLatitudeBands(size_t count, const SphereRegion& region = {}, 
+    bool jitter = false, uint32_t seed = 0, unsigned threads = 0);
+
+/**
+ * 30-bit Morton code of a point in [-1,1]^3.
+ */
+extern uint32_t mortonCode(vec3 p);
+
+/**
+ * Reorder points along a Morton (Z-order) curve so that points close on the
+ * sphere are close in memory.
+ */
+extern void sortSpaceFilling(std::vector<vec3>& points, unsigned threads = 0);
+
+/**
+ * Pick count points from a space-filling-ordered set by uniform striding, 
+ * which keeps the subset spread over the same area.
+ */
+extern std::vector<vec3> strideSubset(const std::vector<vec3>& points, size_t count);
+
+/**
+ * Closed curve around S2 used by SAMPLING_PATH, at t in [0,1).  curl in [0,1]
+ * sets how far it wobbles in latitude; curl = 0 is a circle of latitude.
+ */
+extern vec3 spherePath(float t, float curl);
+
+/**
+ * Whether consecutive base points of the given SphereSampling mode follow one
+ * curve, as the circle mesh assumes when it joins each fiber to the next.
+ * Point sets have no such neighbours.
+ */
+extern bool samplingIsCurve(int sampling);
+
+/**
+ * Base points for the fibration in the given SphereSampling mode.  The path
+ * mode follows a closed curve around the sphere whose wobble is set by curl;
+ * the other modes are ordered with sortSpaceFilling.
+ */
+extern std::vector<vec3> sampleBasePoints(int sampling, size_t count, float curl = 0);
+
+#endif
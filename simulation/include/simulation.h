@@ -3,9 +3,12 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <future>
 #include <memory>
 
+#include "fiberbvh.h"
 #include "hopf.h"
+#include "timeline.h"
 #include "ui.h"
 #include "window.h"
 #include "shader.h"
@@ -13,6 +16,10 @@
 #define UI_PARAMS_PANEL_WIDTH 600
 #define UI_PARAMS_PANEL_HEIGHT 200
 
+// Tube radius the cursor picks fibers by; a little over the drawn radius, so
+// thin tubes are easy to hover.
+#define FIBER_PICK_RADIUS 0.03f
+
 
 /**********************************************************************************
  * 
@@ -23,7 +30,12 @@
 
 class HopfSimulation : public BaseViewWindow {
 public:
-    HopfSimulation(const char* title, int width, int height, int x, int y);
+    /**
+     * @param autotune - Time the fiber kernels' work group sizes before
+     *                   starting and save the fastest to HOPF_TUNING_FILE.
+     *                   Otherwise previously saved sizes are used.
+     */
+    HopfSimulation(const char* title, int width, int height, int x, int y, bool autotune = false);
 
 protected:
     void windowLoop();
@@ -34,6 +46,26 @@ protected:
     void updatePositions();
     void updateSimulation();
 
+    /**
+     * Note the rotation of the base points and pick again if the fibers
+     * moved or a rebuilt index came in.  The index itself is only brought
+     * up to date by fiberIndexReady, when a pick needs it.
+     */
+    void updateFiberIndex(const mat3& rotation);
+
+    /**
+     * Bring the fiber index up to the current points and rotation: refit in
+     * place for a new rotation, or rebuild on a worker thread for new
+     * points.  Returns false while a rebuild is still running.
+     */
+    bool fiberIndexReady();
+
+    /**
+     * Highlight the fiber under the mouse in the scene viewport, and its
+     * base point in the S2 viewport.
+     */
+    void pickFiber();
+
     void renderUI();
 
     static void controlViewportRenderCallback(void* usr, Camera& camera);
@@ -52,12 +84,25 @@ protected:
 
     std::shared_ptr<ShaderManager> shaderManager;
     std::shared_ptr<SimulationParams> params;
+    std::shared_ptr<GpuArena> arena;
 
     std::unique_ptr<CameraUpdater> m_cameraUpdater;
 
+    AnimationTimeline m_timeline;
+
     HopfFibrationDisplay  m_hopfDisplay;
     SphereController      m_controller;
 
+    // CPU copy of the fibers drawn, for picking without reading the GPU back.
+    FiberIndex m_fiberIndex;
+    std::future<FiberIndex> m_indexBuild;   // Rebuild in flight, if valid
+    std::vector<vec3> m_basePositions;
+    mat3 m_rotation = mat3(1.0f);           // Of the points drawn
+    mat3 m_indexRotation = mat3(1.0f);      // Of the points indexed, or being indexed
+    size_t m_indexCount = 0;                // Fibers indexed, or being indexed
+    bool m_indexDirty = true;               // Base points changed since the last rebuild started
+    uint32_t m_hoveredFiber = FIBER_BVH_MISS;
+
     ImGuiContextGLFW ui;
 
     Viewport m_controlViewport, m_sceneViewport;
@@ -0,0 +1,47 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include "defines.h"
+
+/**********************************************************************************
+ * 
+ * Animation as a function of absolute time.  The phase (in revolutions) is
+ * piecewise linear in time: changing the speed rebases the timeline so the
+ * animation carries on from where it was.  Any time can be evaluated directly,
+ * so frames can be skipped, seeked to, or rendered out of order.
+ * 
+ **********************************************************************************/
+
+class AnimationTimeline
+{
+public:
+    /**
+     * @param speed - Revolutions per second.
+     * @param time  - Time at which the new speed takes effect, in seconds.
+     */
+    void setSpeed(double speed, double time);
+    double speed() const {return m_speed;}
+
+    /**
+     * Jump so that the animation is at phase at the given time.
+     */
+    void seek(double time, double phase);
+
+    /**
+     * Phase at the given time, in revolutions.
+     */
+    double phase(double time) const;
+
+    /**
+     * Rotation of the control points at the given time.  Computed exactly
+     * from the phase, so it does not drift however long the animation runs.
+     */
+    mat3 sphereRotation(double time) const;
+
+private:
+    double m_originTime = 0;
+    double m_originPhase = 0;
+    double m_speed = 0;
+};
+
+#endif
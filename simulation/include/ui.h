@@ -46,7 +46,7 @@ class Viewport : public ImGuiElement
 {
 public:
     Viewport();
-    Viewport(int width, int height, ivec2 pos,Camera camera);
+    Viewport(int width, int height, ivec2 pos,Camera&& camera);
 
     bool add(ImGuiContextGLFW * ctx);
     void render();
@@ -61,6 +61,12 @@ public:
      * to the center of the viewport. 
      */
     ivec2 getMousePos(ivec2 mousePos);
+
+    /**
+     * Mouse position in the normalized device coordinates of the area the
+     * camera renders to.  Outside [-1,1] when the mouse is off that area.
+     */
+    vec2 getMouseNDC(vec2 mousePos);
     ivec2 getCenterAbs();
 
     void fixPos(ivec2 pos);
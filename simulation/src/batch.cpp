@@ -0,0 +1,335 @@
+#include "batch.h"
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "defines.h"
+#include "offscreen.h"
+#include "timeline.h"
+
+/**********************************************************************************
+ *
+ * Command line
+ *
+ **********************************************************************************/
+static void printBatchUsage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s --batch --frames <first>:<last> [--fps <n>] [--workers <n>]\n"
+        "          [--size <w>x<h>] [--out <dir>] [--shaders <dir>] [--speed <rev/s>]\n"
+        "          [--sampling <mode>] [--curl <c>] [--fiber-motion] [--software]\n", program);
+}
+
+bool parseBatchOptions(int argc, char** argv, BatchOptions& options)
+{
+    bool haveFrames = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i],"--batch"))
+            continue;
+        else if (!strcmp(argv[i],"--frames") && hasValue)
+            haveFrames = sscanf(argv[++i], "%d:%d", &options.firstFrame, &options.lastFrame) == 2;
+        else if (!strcmp(argv[i],"--fps") && hasValue)
+            options.fps = atof(argv[++i]);
+        else if (!strcmp(argv[i],"--workers") && hasValue)
+            options.workers = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--size") && hasValue)
+        {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+                options.width = 0;
+        }
+        else if (!strcmp(argv[i],"--out") && hasValue)
+            options.outputDir = argv[++i];
+        else if (!strcmp(argv[i],"--shaders") && hasValue)
+            options.shaderDir = argv[++i];
+        else if (!strcmp(argv[i],"--speed") && hasValue)
+            options.animSpeed = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--sampling") && hasValue)
+            options.sampling = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--curl") && hasValue)
+            options.curl = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--fiber-motion"))
+            options.fiberMotion = true;
+        else if (!strcmp(argv[i],"--software"))
+            options.software = true;
+        else
+        {
+            printBatchUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (!haveFrames || options.lastFrame < options.firstFrame || options.fps <= 0
+        || options.width <= 0 || options.height <= 0 || options.workers < 0)
+    {
+        printBatchUsage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+#ifndef _WIN32
+
+/**********************************************************************************
+ *
+ * Shared state.  Lives in an anonymous shared mapping created before fork, so
+ * only lock-free atomics are used.
+ *
+ **********************************************************************************/
+static_assert(std::atomic<int>::is_always_lock_free);
+static_assert(std::atomic<long long>::is_always_lock_free);
+
+struct BatchWorkerStats
+{
+    std::atomic<int> frames;
+    std::atomic<long long> busyNs;    // Time spent rendering and writing frames
+};
+
+#define BATCH_MAX_WORKERS 256
+
+struct BatchShared
+{
+    std::atomic<int> nextFrame;
+    std::atomic<int> framesDone;
+    std::atomic<int> failedWorkers;     // Workers that gave up, whatever their exit status
+    BatchWorkerStats workers[BATCH_MAX_WORKERS];
+};
+
+/**********************************************************************************
+ *
+ * Worker
+ *
+ **********************************************************************************/
+static bool writePPM(const char* path, const std::vector<unsigned char>& rgb, int width, int height)
+{
+    FILE* file = fopen(path, "wb");
+
+    if (!file) {
+        fprintf(stderr, "ERROR: could not open file: %s \n", path);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    // GL rows start at the bottom
+    for (int y = height - 1; y >= 0; y--)
+        fwrite(rgb.data() + (size_t)y*width*3, 1, (size_t)width*3, file);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+/**
+ * Render frames until none are left.  Returns false if the scene could not
+ * be set up or a frame could not be written.
+ */
+static bool renderFrames(const BatchOptions& options, BatchShared* shared, BatchWorkerStats& stats)
+{
+    using clock = std::chrono::steady_clock;
+
+    OffscreenScene scene(options.shaderDir, options.sampling, options.curl, options.width, options.height);
+    OffscreenTarget target;
+
+    scene.params().fiberMotion = options.fiberMotion;
+
+    if (!scene.ready() || !target.create(options.width, options.height))
+        return false;
+
+    AnimationTimeline timeline;
+    timeline.setSpeed(options.animSpeed, 0);
+
+    std::vector<unsigned char> pixels;
+    std::vector<char> path(options.outputDir.size() + 32);
+
+    bool ok = true;
+    int frame;
+    while ((frame = shared->nextFrame.fetch_add(1)) <= options.lastFrame)
+    {
+        auto start = clock::now();
+        double time = (double)frame/options.fps;
+
+        scene.update(timeline.sphereRotation(time));
+
+        target.bind();
+        scene.render();
+        target.readPixels(pixels);
+
+        snprintf(path.data(), path.size(), "%s/frame_%06d.ppm", options.outputDir.c_str(), frame);
+        if (!writePPM(path.data(), pixels, options.width, options.height))
+        {
+            ok = false;
+            break;
+        }
+
+        stats.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+        stats.frames++;
+        shared->framesDone++;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return ok;
+}
+
+static int runWorker(const BatchOptions& options, BatchShared* shared, int worker)
+{
+    HeadlessContext* context = createHeadlessContext(options.software);
+
+    if (!context) {
+        fprintf(stderr, "ERROR: worker %d has no GL context\n", worker);
+        shared->failedWorkers++;
+        return 1;
+    }
+
+    // GL objects must go before the context does.  ShaderManager still
+    // throws for a program it never built; that fails the worker too,
+    // rather than aborting it with nothing recorded.
+    bool ok = false;
+    try {
+        ok = renderFrames(options, shared, shared->workers[worker]);
+    }
+    catch (const std::exception& error) {
+        fprintf(stderr, "ERROR: worker %d: %s\n", worker, error.what());
+    }
+
+    destroyHeadlessContext(context);
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: worker %d failed\n", worker);
+        shared->failedWorkers++;
+        return 1;
+    }
+    return 0;
+}
+
+/**********************************************************************************
+ *
+ * Coordinator
+ *
+ **********************************************************************************/
+int runBatchRender(const BatchOptions& options)
+{
+    using clock = std::chrono::steady_clock;
+
+    int frameCount = options.lastFrame - options.firstFrame + 1;
+    int workers = options.workers ? options.workers : (int)std::max(1u, std::thread::hardware_concurrency());
+    workers = std::min({workers, frameCount, BATCH_MAX_WORKERS});
+
+    std::error_code error;
+    std::filesystem::create_directories(options.outputDir, error);
+    if (error) {
+        fprintf(stderr, "ERROR: could not create directory: %s \n", options.outputDir.c_str());
+        return 1;
+    }
+
+    size_t sharedSize = sizeof(BatchShared);
+    void* mapping = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (mapping == MAP_FAILED) {
+        perror("ERROR: mmap");
+        return 1;
+    }
+
+    BatchShared* shared = new (mapping) BatchShared();
+    shared->nextFrame = options.firstFrame;
+
+    printf("Rendering frames %d..%d at %dx%d on %d workers\n",
+        options.firstFrame, options.lastFrame, options.width, options.height, workers);
+
+    // Flush before forking so buffered output is not duplicated.
+    fflush(stdout);
+    fflush(stderr);
+
+    auto start = clock::now();
+    std::vector<pid_t> pids;
+
+    for (int i = 0; i < workers; i++)
+    {
+        pid_t pid = fork();
+
+        if (pid == 0)
+            _exit(runWorker(options, shared, i));
+
+        if (pid < 0) {
+            perror("ERROR: fork");
+            break;
+        }
+        pids.push_back(pid);
+    }
+
+    size_t running = pids.size();
+    int crashedWorkers = 0;
+
+    while (running)
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+
+        if (pid > 0)
+        {
+            running--;
+            if (!WIFEXITED(status))
+                crashedWorkers++;
+            continue;
+        }
+
+        printf("\r%d/%d frames", shared->framesDone.load(), frameCount);
+        fflush(stdout);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    int framesDone = shared->framesDone.load();
+    int failedWorkers = shared->failedWorkers.load() + crashedWorkers + (workers - (int)pids.size());
+
+    printf("\r%d/%d frames in %.2f s (%.2f frames/s)\n", framesDone, frameCount, elapsed, framesDone/elapsed);
+
+    for (int i = 0; i < workers; i++)
+    {
+        int frames = shared->workers[i].frames.load();
+        double busy = 1e-9*(double)shared->workers[i].busyNs.load();
+        printf("  worker %2d: %5d frames, %.2f frames/s\n", i, frames, busy > 0 ? frames/busy : 0.0);
+    }
+
+    munmap(mapping, sharedSize);
+
+    // Frames a failed worker left are taken by the others, but a frame it
+    // had claimed may be lost.
+    if (framesDone < frameCount || failedWorkers)
+    {
+        fprintf(stderr, "ERROR: %d frames were not rendered (%d workers failed)\n", frameCount - framesDone, failedWorkers);
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+int runBatchRender(const BatchOptions& options)
+{
+    fprintf(stderr, "ERROR: batch rendering needs fork() and is not available on this platform\n");
+    return 1;
+}
+
+#endif
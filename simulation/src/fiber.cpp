@@ -0,0 +1,437 @@
+#include "fiber.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+
+#include "defines.h"
+
+/**********************************************************************************
+ * 
+ * Closed-form fiber circles
+ * 
+ **********************************************************************************/
+
+/*
+ * With (a,b,c) = (p.z,p.y,p.x) the fiber is 
+ *
+ *     q(t) = (r1 cos t, r1 sin t, r2 cos(theta2 - t), r2 sin(theta2 - t))
+ *
+ * with r1 = sqrt((1+a)/2), r2 = sqrt((1-a)/2), theta2 = atan2(-c,b).  The 
+ * points of q with largest and smallest w project to opposite ends of a 
+ * diameter, which gives
+ *
+ *     center = (-c,-b,0)/(1+a)
+ *     radius = sqrt(2/(1+a))
+ *     normal = (-b,c,1+a)/sqrt(2(1+a))
+ *
+ * and the fiber through the pole (a = -1) is the z axis.
+ */
+template<typename T>
+FiberCircle<T> fiberCircle(glm::vec<3,T> p)
+{
+    typedef glm::vec<3,T> vec3T;
+
+    // The formulas below assume |p| = 1 exactly, which matters near the pole.
+    p = glm::normalize(p);
+
+    T a = p.z;
+    T b = p.y;
+    T c = p.x;
+
+    T rho2 = b*b + c*c;
+    T rho = std::sqrt(rho2);
+
+    // 1 + a cancels badly near the pole; use (1+a)(1-a) = b^2 + c^2 there.
+    T onePlusA = a >= 0 ? 1 + a : rho2/(1 - a);
+
+    FiberCircle<T> circle;
+
+    // Direction from the center towards the origin, in the plane of the circle.
+    circle.axis = rho > 0 ? vec3T(c/rho, b/rho, 0) : vec3T(1,0,0);
+
+    if (!(onePlusA > std::numeric_limits<T>::min()))
+    {
+        circle.center = vec3T(0);
+        circle.normal = rho > 0 ? vec3T(-b/rho, c/rho, 0) : vec3T(0,1,0);
+        circle.axis = vec3T(0,0,1);
+        circle.binormal = glm::cross(circle.normal, circle.axis);
+        circle.radius = std::numeric_limits<T>::infinity();
+        circle.isLine = true;
+        return circle;
+    }
+
+    circle.center = vec3T(-c, -b, 0)/onePlusA;
+    circle.radius = std::sqrt(2/onePlusA);
+    circle.normal = vec3T(-b, c, onePlusA)/std::sqrt(2*onePlusA);
+    circle.binormal = glm::cross(circle.normal, circle.axis);
+    circle.isLine = false;
+
+    return circle;
+}
+
+template<typename T>
+void fiberCircles(const glm::vec<3,T>* points, size_t count, FiberCircle<T>* out)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = fiberCircle(points[i]);
+}
+
+template FiberCircle<float> fiberCircle(glm::vec<3,float> p);
+template FiberCircle<double> fiberCircle(glm::vec<3,double> p);
+template void fiberCircles(const glm::vec<3,float>* points, size_t count, FiberCircle<float>* out);
+template void fiberCircles(const glm::vec<3,double>* points, size_t count, FiberCircle<double>* out);
+
+/**********************************************************************************
+ * 
+ * Fiber motion
+ * 
+ **********************************************************************************/
+
+/*
+ * With z1 = x0 + i x1 and w2 = x2 - i x3, a point q of S3 lies over 
+ * n = (b,c,a) = (p.y,p.x,p.z), where
+ *
+ *     (z1,w2)(z1,w2)^* = (I + n.sigma)/2
+ *
+ * for the Pauli matrices sigma.  A U in SU(2) acting on (z1,w2) therefore
+ * rotates n by the rotation U represents, and maps fibers to fibers.  The
+ * rotation of n is the rotation of p conjugated by the swap of x and y.
+ */
+template<typename T>
+glm::mat<4,4,T> fiberMotion(const glm::mat<3,3,T>& rotation)
+{
+    typedef std::complex<T> complexT;
+
+    // Entry (i,j) of the rotation of n; glm matrices are column major.
+    const int swap[3] = {1, 0, 2};
+    auto r = [&](int i, int j) {return rotation[swap[j]][swap[i]];};
+
+    // Unit quaternion (w,x,y,z) of that rotation.
+    T trace = r(0,0) + r(1,1) + r(2,2);
+    T w, x, y, z;
+
+    if (trace > 0)
+    {
+        T s = 2*std::sqrt(1 + trace);
+        w = s/4;
+        x = (r(2,1) - r(1,2))/s;
+        y = (r(0,2) - r(2,0))/s;
+        z = (r(1,0) - r(0,1))/s;
+    }
+    else if (r(0,0) > r(1,1) && r(0,0) > r(2,2))
+    {
+        T s = 2*std::sqrt(1 + r(0,0) - r(1,1) - r(2,2));
+        w = (r(2,1) - r(1,2))/s;
+        x = s/4;
+        y = (r(0,1) + r(1,0))/s;
+        z = (r(0,2) + r(2,0))/s;
+    }
+    else if (r(1,1) > r(2,2))
+    {
+        T s = 2*std::sqrt(1 + r(1,1) - r(0,0) - r(2,2));
+        w = (r(0,2) - r(2,0))/s;
+        x = (r(0,1) + r(1,0))/s;
+        y = s/4;
+        z = (r(1,2) + r(2,1))/s;
+    }
+    else
+    {
+        T s = 2*std::sqrt(1 + r(2,2) - r(0,0) - r(1,1));
+        w = (r(1,0) - r(0,1))/s;
+        x = (r(0,2) + r(2,0))/s;
+        y = (r(1,2) + r(2,1))/s;
+        z = s/4;
+    }
+
+    // U = w - i(x,y,z).sigma = [[alpha, beta], [-conj(beta), conj(alpha)]]
+    complexT alpha(w, -z);
+    complexT beta(-y, -x);
+
+    glm::mat<4,4,T> motion;
+
+    for (int column = 0; column < 4; column++)
+    {
+        glm::vec<4,T> q(0);
+        q[column] = 1;
+
+        complexT z1(q.x, q.y);
+        complexT w2(q.z, -q.w);
+
+        complexT z1Moved = alpha*z1 + beta*w2;
+        complexT w2Moved = -std::conj(beta)*z1 + std::conj(alpha)*w2;
+
+        motion[column] = glm::vec<4,T>(z1Moved.real(), z1Moved.imag(), w2Moved.real(), -w2Moved.imag());
+    }
+
+    return motion;
+}
+
+template glm::mat<4,4,float> fiberMotion(const glm::mat<3,3,float>& rotation);
+template glm::mat<4,4,double> fiberMotion(const glm::mat<3,3,double>& rotation);
+
+/**********************************************************************************
+ * 
+ * Fiber generation
+ * 
+ **********************************************************************************/
+void sampleFibers(const vec3* basePoints, size_t fiberCount, uint fiberRes, Vertex* out)
+{
+    for (size_t i = 0; i < fiberCount; i++)
+    {
+        FiberCircle<float> circle = fiberCircle(basePoints[i]);
+
+        for (uint j = 0; j < fiberRes; j++)
+        {
+            float t = 2*PI*(float)j/(float)fiberRes;
+
+            Vertex& vertex = out[i*fiberRes + j];
+            vertex.position = vec4(circle.point(t),1.0f);
+            vertex.color = vec4(1.0f);
+            vertex.normal = vec4(0.0f);
+        }
+    }
+}
+
+/**********************************************************************************
+ * 
+ * Fiber surfaces
+ * 
+ **********************************************************************************/
+
+// Splits of one initial curve interval, beyond which the curve is taken as is.
+#define HOPF_SURFACE_MAX_DEPTH 12
+
+// Step along the curve for the normals' finite differences.
+#define HOPF_SURFACE_NORMAL_STEP 1e-3f
+
+struct SurfaceRing
+{
+    FiberCircle<float> circle;
+    float phase;    // Fiber parameter of the first vertex
+    uint first;     // First vertex
+    uint segments;  // Vertices around the fiber; 0 if it was left out
+};
+
+static bool surfaceFiber(const FiberCircle<float>& circle, float maxRadius)
+{
+    return !circle.isLine && circle.radius <= maxRadius;
+}
+
+// Fiber parameter of the point of the circle closest to p.
+static float closestPhase(const FiberCircle<float>& circle, vec3 p)
+{
+    vec3 d = p - circle.center;
+    return std::atan2(glm::dot(d, circle.binormal), glm::dot(d, circle.axis));
+}
+
+static float circleDistance(const FiberCircle<float>& circle, vec3 p)
+{
+    vec3 d = p - circle.center;
+    float height = glm::dot(d, circle.normal);
+    float across = glm::length(d - height*circle.normal) - circle.radius;
+    return std::sqrt(height*height + across*across);
+}
+
+// Largest distance of the fiber over an interval's midpoint from the average
+// of the fibers at its ends, sampled at four points.  Points are matched by
+// proximity, since fiber parameters of neighbouring fibers can be far apart.
+static float fiberDeviation(const FiberCircle<float>& a, const FiberCircle<float>& mid, const FiberCircle<float>& b)
+{
+    float deviation = 0;
+
+    for (int k = 0; k < 4; k++)
+    {
+        vec3 pa = a.point(PI/4 + k*PI/2);
+        vec3 pb = b.point(closestPhase(b, pa));
+        deviation = std::max(deviation, circleDistance(mid, 0.5f*(pa + pb)));
+    }
+    return deviation;
+}
+
+// Triangles between two rings, advancing around whichever ring's next vertex
+// comes first.
+static void stitchRings(const SurfaceRing& a, const SurfaceRing& b, std::vector<uint>& indices)
+{
+    uint i = 0;
+    uint j = 0;
+
+    while (i < a.segments || j < b.segments)
+    {
+        uint a0 = a.first + i % a.segments;
+        uint b0 = b.first + j % b.segments;
+
+        // (i+1)/a.segments <= (j+1)/b.segments
+        bool advanceA = j == b.segments || 
+            (i < a.segments && (uint64_t)(i + 1)*b.segments <= (uint64_t)(j + 1)*a.segments);
+
+        if (advanceA)
+        {
+            indices.insert(indices.end(), {a0, a.first + (i + 1) % a.segments, b0});
+            i++;
+        }
+        else
+        {
+            indices.insert(indices.end(), {a0, b.first + (j + 1) % b.segments, b0});
+            j++;
+        }
+    }
+}
+
+void hopfSurface(const std::function<vec3(float)>& curve, const HopfSurfaceOptions& options,
+    std::vector<Vertex>& vertices, std::vector<uint>& indices)
+{
+    vertices.clear();
+    indices.clear();
+
+    auto fiberAt = [&](float u)
+    {
+        u -= std::floor(u);
+        return fiberCircle(curve(u));
+    };
+
+    // Curve parameters of the rings.  Each initial interval is split depth
+    // first, left half first, so they come out in order.
+    struct Interval
+    {
+        float u0;
+        float u1;
+        uint depth;
+    };
+
+    uint initial = std::max(options.minCurveSegments, 3u);
+    std::vector<float> params;
+    std::vector<Interval> stack;
+
+    for (uint i = 0; i < initial; i++)
+    {
+        stack.push_back({(float)i/initial, (float)(i + 1)/initial, 0});
+
+        while (!stack.empty())
+        {
+            Interval interval = stack.back();
+            stack.pop_back();
+
+            float mid = 0.5f*(interval.u0 + interval.u1);
+            FiberCircle<float> a = fiberAt(interval.u0);
+            FiberCircle<float> m = fiberAt(mid);
+            FiberCircle<float> b = fiberAt(interval.u1);
+
+            bool split = interval.depth < HOPF_SURFACE_MAX_DEPTH &&
+                params.size() + stack.size() + (initial - i) < options.maxCurveSegments &&
+                surfaceFiber(a, options.maxRadius) && surfaceFiber(m, options.maxRadius) && 
+                surfaceFiber(b, options.maxRadius) && fiberDeviation(a, m, b) > options.tolerance;
+
+            if (split)
+            {
+                stack.push_back({mid, interval.u1, interval.depth + 1});
+                stack.push_back({interval.u0, mid, interval.depth + 1});
+            }
+            else
+                params.push_back(interval.u0);
+        }
+    }
+
+    size_t ringCount = params.size();
+    std::vector<SurfaceRing> rings(ringCount);
+    bool closed = true;
+
+    for (size_t i = 0; i < ringCount; i++)
+    {
+        rings[i].circle = fiberAt(params[i]);
+        rings[i].phase = 0;
+        closed = closed && surfaceFiber(rings[i].circle, options.maxRadius);
+    }
+
+    // Start each ring at the point closest to the start of the ring before,
+    // so quads between rings are not sheared.  An open surface is walked from
+    // just after a gap.
+    size_t origin = 0;
+    while (!closed && surfaceFiber(rings[origin].circle, options.maxRadius))
+        origin++;
+
+    bool started = false;
+    vec3 start;
+
+    for (size_t k = 0; k < ringCount; k++)
+    {
+        SurfaceRing& ring = rings[(origin + k) % ringCount];
+
+        if (!surfaceFiber(ring.circle, options.maxRadius))
+        {
+            started = false;
+            continue;
+        }
+        if (started)
+            ring.phase = closestPhase(ring.circle, start);
+
+        start = ring.circle.point(ring.phase);
+        started = true;
+    }
+
+    // Around a closed surface the starts come back turned; spread the turn
+    // evenly along the curve.
+    if (closed && ringCount)
+    {
+        float twist = closestPhase(rings[0].circle, start) - rings[0].phase;
+        twist -= 2*PI*std::round(twist/(2*PI));
+
+        for (size_t i = 0; i < ringCount; i++)
+            rings[i].phase -= twist*params[i];
+    }
+
+    // Sample a ring of vertices around each fiber.
+    for (size_t i = 0; i < ringCount; i++)
+    {
+        SurfaceRing& ring = rings[i];
+        const FiberCircle<float>& circle = ring.circle;
+
+        ring.first = (uint)vertices.size();
+        ring.segments = 0;
+
+        if (!surfaceFiber(circle, options.maxRadius))
+            continue;
+
+        // Chords of n segments stray radius*(1 - cos(pi/n)) from the circle.
+        float ratio = 1 - options.tolerance/circle.radius;
+        uint segments = ratio > 0 ? (uint)std::ceil(PI/std::acos(ratio)) : 0;
+        segments = std::bit_ceil(std::max(segments, options.minFiberSegments));
+        segments = std::clamp(segments, 3u, options.maxFiberSegments);
+
+        vec3 base = glm::normalize(curve(params[i]));
+        FiberCircle<float> before = fiberAt(params[i] - HOPF_SURFACE_NORMAL_STEP);
+        FiberCircle<float> after = fiberAt(params[i] + HOPF_SURFACE_NORMAL_STEP);
+
+        for (uint j = 0; j < segments; j++)
+        {
+            float t = ring.phase + 2*PI*(float)j/(float)segments;
+            vec3 p = circle.point(t);
+
+            // Winding of stitchRings faces along cross(d/dt, d/du).
+            vec3 alongFiber = -std::sin(t)*circle.axis + std::cos(t)*circle.binormal;
+            vec3 alongCurve = after.point(closestPhase(after, p)) - before.point(closestPhase(before, p));
+            vec3 normal = glm::cross(alongFiber, alongCurve);
+            float length = glm::length(normal);
+
+            Vertex vertex;
+            vertex.position = vec4(p, 1.0f);
+            vertex.color = vec4(0.5f*(base + 1.0f), 1.0f);
+            vertex.normal = vec4(length > 0 ? normal/length : circle.normal, 0.0f);
+            vertices.push_back(vertex);
+        }
+        ring.segments = segments;
+    }
+
+    // The curve is closed, so the last ring joins the first.
+    for (size_t i = 0; i < ringCount; i++)
+    {
+        const SurfaceRing& a = rings[i];
+        const SurfaceRing& b = rings[(i + 1) % ringCount];
+
+        if (a.segments && b.segments)
+            stitchRings(a, b, indices);
+    }
+}
@@ -0,0 +1,990 @@
+#include "fiberbvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "fiber.h"
+#include "misc.h"
+
+// Bins per axis of the surface area heuristic.
+#define BVH_BINS 16
+
+// Items past which a node is always split.
+#define BVH_MAX_LEAF_SIZE 8
+
+// Cost of visiting a node, relative to testing one item.
+#define BVH_TRAVERSAL_COST 1.0f
+
+// Depth past which nodes are halved rather than split by cost, which bounds
+// the traversal stack below.
+#define BVH_MAX_DEPTH 48
+#define BVH_STACK_SIZE 96
+
+// Growth of the summed node areas, over those of a fresh build, past which
+// FiberIndex::update rebuilds rather than refits.
+#define REFIT_REBUILD_RATIO 1.5f
+
+// Arcs each fiber is cut into for FiberIndex.  Whole circles have boxes so
+// large that they nearly all overlap; arcs bound them far more tightly.
+#define FIBER_INDEX_ARCS 8
+
+// Fibers below which FiberIndex updates on the calling thread alone.
+#define FIBER_INDEX_PARALLEL_MIN 16384
+
+// Sphere tracing limits for FiberIndex::pick.  Rays that graze a tube may
+// not converge within the steps, and count as misses.
+#define PICK_MAX_STEPS 256
+#define PICK_EPSILON 1e-3f      // Relative to the tube radius
+
+/**********************************************************************************
+ *
+ * Geometry
+ *
+ **********************************************************************************/
+
+void RayPacket::set(int lane, const Ray& ray)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        origin[axis][lane] = ray.origin[axis];
+        dir[axis][lane] = ray.dir[axis];
+    }
+    tMax[lane] = ray.tMax;
+    segment[lane] = FIBER_BVH_MISS;
+}
+
+std::vector<FiberSegment> fiberSegments(const std::vector<vec3>& basePoints, uint fiberRes, float radius)
+{
+    std::vector<FiberSegment> segments;
+    segments.reserve(basePoints.size()*fiberRes);
+
+    for (size_t i = 0; i < basePoints.size(); i++)
+    {
+        FiberCircle<float> circle = fiberCircle(basePoints[i]);
+
+        if (circle.isLine)
+            continue;
+
+        // Closed, like the tubes drawn by the raster path.
+        vec3 previous = circle.point(0);
+
+        for (uint j = 1; j <= fiberRes; j++)
+        {
+            vec3 next = circle.point(2*PI*(float)(j % fiberRes)/(float)fiberRes);
+            segments.push_back({previous, next, radius, (uint32_t)i});
+            previous = next;
+        }
+    }
+    return segments;
+}
+
+// Distance along rd (normalized) to the first hit with the capsule from pa
+// to pb, or -1 if the ray misses.  Same as fiber_impostor.frag.
+static float capsuleIntersect(vec3 ro, vec3 rd, vec3 pa, vec3 pb, float r)
+{
+    vec3 ba = pb - pa;
+    vec3 oa = ro - pa;
+
+    float baba = glm::dot(ba,ba);
+    float bard = glm::dot(ba,rd);
+    float baoa = glm::dot(ba,oa);
+    float rdoa = glm::dot(rd,oa);
+    float oaoa = glm::dot(oa,oa);
+
+    // Cylinder
+    float a = baba - bard*bard;
+    float b = baba*rdoa - baoa*bard;
+    float c = baba*oaoa - baoa*baoa - r*r*baba;
+    float h = b*b - a*c;
+
+    if (h >= 0)
+    {
+        float t = (-b - std::sqrt(h))/a;
+        float y = baoa + t*bard;
+
+        if (y > 0 && y < baba)
+            return t;
+
+        // Cap at the end the ray reaches first
+        vec3 oc = (y <= 0) ? oa : ro - pb;
+        b = glm::dot(rd,oc);
+        c = glm::dot(oc,oc) - r*r;
+        h = b*b - c;
+
+        if (h > 0)
+            return -b - std::sqrt(h);
+    }
+
+    return -1;
+}
+
+// Reciprocal that stays finite for zero direction components.
+static inline float safeInverse(float x)
+{
+    const float tiny = 1e-20f;
+    return 1/(std::abs(x) > tiny ? x : std::copysign(tiny, x));
+}
+
+static inline float halfArea(vec3 lo, vec3 hi)
+{
+    vec3 e = glm::max(hi - lo, vec3(0));
+    return e.x*e.y + e.y*e.z + e.z*e.x;
+}
+
+vec3 FiberBVH::normal(uint32_t segment, vec3 p) const
+{
+    const FiberSegment& s = m_segments[segment];
+
+    vec3 ba = s.b - s.a;
+    float baba = glm::dot(ba,ba);
+    float h = baba > 0 ? std::clamp(glm::dot(p - s.a, ba)/baba, 0.0f, 1.0f) : 0.0f;
+
+    return glm::normalize(p - (s.a + h*ba));
+}
+
+/**********************************************************************************
+ *
+ * Construction
+ *
+ **********************************************************************************/
+
+/**
+ * Build the subtree over items order[begin,end) into nodes, partitioning that
+ * range of order so each leaf covers a contiguous run of it.  Returns the
+ * index of the subtree's root.
+ */
+static uint32_t buildNode(std::vector<BVHNode>& nodes, std::vector<uint32_t>& order, uint32_t begin, uint32_t end,
+    uint32_t depth, const std::vector<vec3>& lo, const std::vector<vec3>& hi, const std::vector<vec3>& centroids)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.push_back({});
+
+    BVHNode node;
+    node.lo = vec3(inf);
+    node.hi = vec3(-inf);
+    node.offset = begin;
+    node.count = (uint16_t)std::min<uint32_t>(end - begin, UINT16_MAX);
+    node.axis = 0;
+
+    vec3 centroidLo(inf), centroidHi(-inf);
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        node.lo = glm::min(node.lo, lo[order[i]]);
+        node.hi = glm::max(node.hi, hi[order[i]]);
+        centroidLo = glm::min(centroidLo, centroids[order[i]]);
+        centroidHi = glm::max(centroidHi, centroids[order[i]]);
+    }
+
+    uint32_t count = end - begin;
+    vec3 extent = centroidHi - centroidLo;
+    int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+    uint32_t mid = begin;
+
+    if (count > 2 && extent[axis] > 0 && depth < BVH_MAX_DEPTH)
+    {
+        struct Bin
+        {
+            vec3 lo = vec3(std::numeric_limits<float>::infinity());
+            vec3 hi = vec3(-std::numeric_limits<float>::infinity());
+            uint32_t count = 0;
+
+            void grow(vec3 l, vec3 h, uint32_t n) {lo = glm::min(lo,l); hi = glm::max(hi,h); count += n;}
+        };
+
+        float scale = BVH_BINS/extent[axis];
+        auto binOf = [&](uint32_t s)
+        {
+            return std::min((int)((centroids[s][axis] - centroidLo[axis])*scale), BVH_BINS - 1);
+        };
+
+        Bin bins[BVH_BINS];
+        for (uint32_t i = begin; i < end; i++)
+            bins[binOf(order[i])].grow(lo[order[i]], hi[order[i]], 1);
+
+        // Areas and counts right of each bin boundary, then a sweep from the
+        // left for the cost of each.
+        float rightArea[BVH_BINS];
+        uint32_t rightCount[BVH_BINS];
+        Bin right;
+
+        for (int b = BVH_BINS - 1; b > 0; b--)
+        {
+            right.grow(bins[b].lo, bins[b].hi, bins[b].count);
+            rightArea[b] = halfArea(right.lo, right.hi);
+            rightCount[b] = right.count;
+        }
+
+        Bin left;
+        float bestCost = inf;
+        int bestSplit = -1;
+
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            left.grow(bins[b].lo, bins[b].hi, bins[b].count);
+
+            if (!left.count || !rightCount[b + 1])
+                continue;
+
+            float cost = halfArea(left.lo, left.hi)*left.count + rightArea[b + 1]*rightCount[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        float splitCost = BVH_TRAVERSAL_COST + bestCost/std::max(halfArea(node.lo, node.hi), 1e-30f);
+
+        if (bestSplit >= 0 && (count > BVH_MAX_LEAF_SIZE || splitCost < (float)count))
+        {
+            mid = (uint32_t)(std::partition(order.begin() + begin, order.begin() + end,
+                [&](uint32_t s) {return binOf(s) <= bestSplit;}) - order.begin());
+        }
+    }
+
+    // Too many for one leaf, but no split by cost: halve along the axis.
+    if ((mid == begin || mid == end) && count > BVH_MAX_LEAF_SIZE)
+    {
+        mid = begin + count/2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+            [&](uint32_t a, uint32_t b) {return centroids[a][axis] < centroids[b][axis];});
+    }
+
+    if (mid == begin || mid == end)
+    {
+        nodes[index] = node;
+        return index;
+    }
+
+    node.count = 0;
+    node.axis = (uint16_t)axis;
+    nodes[index] = node;
+
+    buildNode(nodes, order, begin, mid, depth + 1, lo, hi, centroids);
+    nodes[index].offset = buildNode(nodes, order, mid, end, depth + 1, lo, hi, centroids);
+
+    return index;
+}
+
+/**
+ * Build nodes over items with the given bounds and centroids.  Returns the
+ * item of each leaf slot.
+ */
+static std::vector<uint32_t> buildTree(std::vector<BVHNode>& nodes,
+    const std::vector<vec3>& lo, const std::vector<vec3>& hi, const std::vector<vec3>& centroids)
+{
+    std::vector<uint32_t> order(lo.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = (uint32_t)i;
+
+    nodes.clear();
+    if (!order.empty())
+    {
+        nodes.reserve(2*order.size()/BVH_MAX_LEAF_SIZE + 1);
+        buildNode(nodes, order, 0, (uint32_t)order.size(), 0, lo, hi, centroids);
+    }
+    return order;
+}
+
+void FiberBVH::build(std::vector<FiberSegment> segments)
+{
+    m_nodes.clear();
+    m_segments.clear();
+
+    size_t count = segments.size();
+    if (!count)
+        return;
+
+    std::vector<vec3> lo(count), hi(count), centroids(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const FiberSegment& s = segments[i];
+
+        lo[i] = glm::min(s.a, s.b) - vec3(s.radius);
+        hi[i] = glm::max(s.a, s.b) + vec3(s.radius);
+        centroids[i] = 0.5f*(s.a + s.b);
+    }
+
+    std::vector<uint32_t> order = buildTree(m_nodes, lo, hi, centroids);
+
+    // Leaves index contiguous runs of the reordered segments.
+    m_segments.reserve(count);
+    for (uint32_t i : order)
+        m_segments.push_back(segments[i]);
+}
+
+/**********************************************************************************
+ *
+ * Traversal
+ *
+ **********************************************************************************/
+
+/**
+ * Part of a ray in the box [lo,hi], clipped to [0,tMax].  Returns false if
+ * there is none, including for empty boxes (lo > hi).
+ */
+static inline bool slabInterval(vec3 lo, vec3 hi, vec3 origin, vec3 invDir, float tMax, float& enter, float& exit)
+{
+    if (lo.x > hi.x)
+        return false;
+
+    vec3 t0 = (lo - origin)*invDir;
+    vec3 t1 = (hi - origin)*invDir;
+    vec3 tNear = glm::min(t0,t1);
+    vec3 tFar = glm::max(t0,t1);
+
+    enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+
+    return enter <= exit;
+}
+
+static inline bool slabTest(vec3 lo, vec3 hi, vec3 origin, vec3 invDir, float tMax)
+{
+    float enter, exit;
+    return slabInterval(lo, hi, origin, invDir, tMax, enter, exit);
+}
+
+bool FiberBVH::intersect(const Ray& ray, RayHit& hit) const
+{
+    hit = RayHit();
+
+    if (m_nodes.empty())
+        return false;
+
+    vec3 invDir(safeInverse(ray.dir.x), safeInverse(ray.dir.y), safeInverse(ray.dir.z));
+    float tBest = ray.tMax;
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        if (!slabTest(node.lo, node.hi, ray.origin, invDir, tBest))
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                const FiberSegment& segment = m_segments[s];
+                float t = capsuleIntersect(ray.origin, ray.dir, segment.a, segment.b, segment.radius);
+
+                if (t > 0 && t < tBest)
+                {
+                    tBest = t;
+                    hit.segment = s;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child first.
+        uint32_t first = index + 1;
+        uint32_t second = node.offset;
+        if (ray.dir[node.axis] < 0)
+            std::swap(first, second);
+
+        stack[top++] = second;
+        stack[top++] = first;
+    }
+
+    hit.t = tBest;
+    return hit.segment != FIBER_BVH_MISS;
+}
+
+bool FiberBVH::occluded(const Ray& ray) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    vec3 invDir(safeInverse(ray.dir.x), safeInverse(ray.dir.y), safeInverse(ray.dir.z));
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        if (!slabTest(node.lo, node.hi, ray.origin, invDir, ray.tMax))
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                const FiberSegment& segment = m_segments[s];
+                float t = capsuleIntersect(ray.origin, ray.dir, segment.a, segment.b, segment.radius);
+
+                if (t > 0 && t < ray.tMax)
+                    return true;
+            }
+            continue;
+        }
+
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+    }
+    return false;
+}
+
+void FiberBVH::intersect(RayPacket& packet) const
+{
+    for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+        packet.segment[lane] = FIBER_BVH_MISS;
+
+    if (m_nodes.empty())
+        return;
+
+    float invDir[3][RAY_PACKET_SIZE];
+    for (int axis = 0; axis < 3; axis++)
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+            invDir[axis][lane] = safeInverse(packet.dir[axis][lane]);
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        // Slab test of every lane.  The loop has no branches, so it
+        // vectorizes across the packet.
+        bool hits[RAY_PACKET_SIZE];
+        bool any = false;
+
+        for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+        {
+            float enter = 0;
+            float exit = packet.tMax[lane];
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float t0 = (node.lo[axis] - packet.origin[axis][lane])*invDir[axis][lane];
+                float t1 = (node.hi[axis] - packet.origin[axis][lane])*invDir[axis][lane];
+                enter = std::max(enter, std::min(t0,t1));
+                exit = std::min(exit, std::max(t0,t1));
+            }
+
+            hits[lane] = enter <= exit;
+            any |= hits[lane];
+        }
+
+        if (!any)
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                const FiberSegment& segment = m_segments[s];
+
+                for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+                {
+                    if (!hits[lane])
+                        continue;
+
+                    vec3 origin(packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]);
+                    vec3 dir(packet.dir[0][lane], packet.dir[1][lane], packet.dir[2][lane]);
+                    float t = capsuleIntersect(origin, dir, segment.a, segment.b, segment.radius);
+
+                    if (t > 0 && t < packet.tMax[lane])
+                    {
+                        packet.tMax[lane] = t;
+                        packet.segment[lane] = s;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // The rays are coherent, so the first one orders the children for all.
+        uint32_t first = index + 1;
+        uint32_t second = node.offset;
+        if (packet.dir[node.axis][0] < 0)
+            std::swap(first, second);
+
+        stack[top++] = second;
+        stack[top++] = first;
+    }
+}
+
+/**********************************************************************************
+ *
+ * Fiber index
+ *
+ **********************************************************************************/
+
+// Distance from p to the centre line of a fiber.
+static float fiberDistance(const FiberCircle<float>& fiber, vec3 p)
+{
+    vec3 d = p - fiber.center;
+
+    if (fiber.isLine)
+        return glm::length(d - glm::dot(d, fiber.axis)*fiber.axis);
+
+    float h = glm::dot(d, fiber.normal);
+    float rho = glm::length(d - h*fiber.normal);
+    return std::sqrt(h*h + (rho - fiber.radius)*(rho - fiber.radius));
+}
+
+static inline bool inBox(vec3 p, vec3 lo, vec3 hi)
+{
+    return p.x >= lo.x && p.y >= lo.y && p.z >= lo.z && p.x <= hi.x && p.y <= hi.y && p.z <= hi.z;
+}
+
+static inline float boxDistance(vec3 p, vec3 lo, vec3 hi)
+{
+    return glm::length(glm::max(glm::max(lo - p, p - hi), vec3(0)));
+}
+
+static inline bool boxesOverlap(vec3 loA, vec3 hiA, vec3 loB, vec3 hiB)
+{
+    return loA.x <= hiB.x && loA.y <= hiB.y && loA.z <= hiB.z &&
+           loB.x <= hiA.x && loB.y <= hiA.y && loB.z <= hiA.z;
+}
+
+/**
+ * Whether the centre line of a fiber passes through the box [lo,hi].  A
+ * circle is inside or outside the box all the way between the angles where
+ * it crosses the planes of the faces, so one point between each pair of
+ * neighbouring crossings decides it.
+ */
+static bool fiberInBox(const FiberCircle<float>& fiber, vec3 lo, vec3 hi)
+{
+    if (fiber.isLine)
+    {
+        float enter = -std::numeric_limits<float>::infinity();
+        float exit = std::numeric_limits<float>::infinity();
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (fiber.axis[k] == 0)
+            {
+                if (fiber.center[k] < lo[k] || fiber.center[k] > hi[k])
+                    return false;
+                continue;
+            }
+
+            float t0 = (lo[k] - fiber.center[k])/fiber.axis[k];
+            float t1 = (hi[k] - fiber.center[k])/fiber.axis[k];
+            enter = std::max(enter, std::min(t0,t1));
+            exit = std::min(exit, std::max(t0,t1));
+        }
+        return enter <= exit;
+    }
+
+    float angles[12];
+    int count = 0;
+
+    for (int k = 0; k < 3; k++)
+    {
+        // Coordinate k along the circle is center + amplitude*cos(t - phase).
+        float a = fiber.radius*fiber.axis[k];
+        float b = fiber.radius*fiber.binormal[k];
+        float amplitude = std::sqrt(a*a + b*b);
+        float phase = std::atan2(b, a);
+
+        if (amplitude <= 0)
+            continue;
+
+        for (float plane : {lo[k], hi[k]})
+        {
+            float c = (plane - fiber.center[k])/amplitude;
+
+            if (std::abs(c) > 1)
+                continue;
+
+            float offset = std::acos(c);
+            for (float angle : {phase + offset, phase - offset})
+                angles[count++] = angle - 2*PI*std::floor(angle/(2*PI));
+        }
+    }
+
+    if (!count)
+        return inBox(fiber.point(0), lo, hi);
+
+    std::sort(angles, angles + count);
+
+    for (int i = 0; i < count; i++)
+    {
+        float next = i + 1 < count ? angles[i + 1] : angles[0] + 2*PI;
+        if (inBox(fiber.point(0.5f*(angles[i] + next)), lo, hi))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * First distance along ray in [t0,t1] at which it meets the tube around a
+ * fiber, or -1.  Sphere traced: the distance to the centre line changes no
+ * faster than the point moves along the ray, so a step of the distance to
+ * the tube never passes through it.
+ */
+static float traceFiber(const FiberCircle<float>& fiber, float radius, const Ray& ray, float t0, float t1)
+{
+    float t = t0;
+
+    for (int i = 0; i < PICK_MAX_STEPS && t <= t1; i++)
+    {
+        float d = fiberDistance(fiber, ray.origin + t*ray.dir) - radius;
+
+        if (d < PICK_EPSILON*radius)
+            return t;
+        t += d;
+    }
+    return -1;
+}
+
+void FiberIndex::setFibers(const std::vector<vec3>& basePoints)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    size_t count = basePoints.size();
+
+    m_circles.resize(count);
+    m_lo.resize(count*FIBER_INDEX_ARCS);
+    m_hi.resize(count*FIBER_INDEX_ARCS);
+
+    // An arc of angle 2*PI/FIBER_INDEX_ARCS strays from its chord by at most
+    // this much per unit radius.
+    const float sagitta = 1 - std::cos(PI/FIBER_INDEX_ARCS);
+
+    parallelFor(count, count < FIBER_INDEX_PARALLEL_MIN ? 1 : 0, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            FiberCircle<float>& circle = m_circles[i];
+            circle = fiberCircle(basePoints[i]);
+
+            vec3 pad = vec3(sagitta*circle.radius + m_radius);
+            vec3 previous = circle.point(0);
+
+            for (uint32_t k = 0; k < FIBER_INDEX_ARCS; k++)
+            {
+                size_t arc = i*FIBER_INDEX_ARCS + k;
+
+                // Lines are left out of the tree by bounds that contain nothing.
+                if (circle.isLine)
+                {
+                    m_lo[arc] = vec3(inf);
+                    m_hi[arc] = vec3(-inf);
+                    continue;
+                }
+
+                vec3 next = circle.point(2*PI*(float)(k + 1)/FIBER_INDEX_ARCS);
+                m_lo[arc] = glm::min(previous, next) - pad;
+                m_hi[arc] = glm::max(previous, next) + pad;
+                previous = next;
+            }
+        }
+    });
+
+    m_lines.clear();
+    for (size_t i = 0; i < count; i++)
+        if (m_circles[i].isLine)
+            m_lines.push_back((uint32_t)i);
+}
+
+float FiberIndex::treeArea() const
+{
+    float area = 0;
+    for (const BVHNode& node : m_nodes)
+        area += halfArea(node.lo, node.hi);
+    return area;
+}
+
+void FiberIndex::build(const std::vector<vec3>& basePoints, float radius)
+{
+    m_radius = radius;
+    setFibers(basePoints);
+
+    std::vector<vec3> centroids(m_lo.size());
+    for (size_t i = 0; i < centroids.size(); i++)
+        centroids[i] = m_circles[i/FIBER_INDEX_ARCS].isLine ? vec3(0) : 0.5f*(m_lo[i] + m_hi[i]);
+
+    m_order = buildTree(m_nodes, m_lo, m_hi, centroids);
+    m_builtArea = treeArea();
+}
+
+void FiberIndex::refit()
+{
+    const float inf = std::numeric_limits<float>::infinity();
+
+    // Children come after their parents, so a backward sweep sees them first.
+    for (size_t i = m_nodes.size(); i-- > 0;)
+    {
+        BVHNode& node = m_nodes[i];
+
+        if (node.count)
+        {
+            node.lo = vec3(inf);
+            node.hi = vec3(-inf);
+
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                node.lo = glm::min(node.lo, m_lo[m_order[s]]);
+                node.hi = glm::max(node.hi, m_hi[m_order[s]]);
+            }
+            continue;
+        }
+
+        node.lo = glm::min(m_nodes[i + 1].lo, m_nodes[node.offset].lo);
+        node.hi = glm::max(m_nodes[i + 1].hi, m_nodes[node.offset].hi);
+    }
+}
+
+void FiberIndex::update(const std::vector<vec3>& basePoints)
+{
+    if (basePoints.size() != m_circles.size())
+    {
+        build(basePoints, m_radius);
+        return;
+    }
+
+    setFibers(basePoints);
+    refit();
+
+    // Refitting keeps the topology, which suits small moves; after large
+    // ones the boxes overlap so much that building afresh pays.
+    if (treeArea() > REFIT_REBUILD_RATIO*m_builtArea)
+        build(basePoints, m_radius);
+}
+
+/**
+ * Sort and deduplicate fibers from first on, since a fiber is found once for
+ * each of its arcs that matches a query.
+ */
+static void uniqueFibers(std::vector<uint32_t>& fibers, size_t first)
+{
+    std::sort(fibers.begin() + first, fibers.end());
+    fibers.erase(std::unique(fibers.begin() + first, fibers.end()), fibers.end());
+}
+
+uint32_t FiberIndex::pick(const Ray& ray, float& t) const
+{
+    uint32_t picked = FIBER_BVH_MISS;
+    float tBest = ray.tMax;
+
+    for (uint32_t fiber : m_lines)
+    {
+        float tHit = traceFiber(m_circles[fiber], m_radius, ray, 0, tBest);
+
+        if (tHit >= 0 && tHit < tBest)
+        {
+            tBest = tHit;
+            picked = fiber;
+        }
+    }
+
+    vec3 invDir(safeInverse(ray.dir.x), safeInverse(ray.dir.y), safeInverse(ray.dir.z));
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    if (!m_nodes.empty())
+        stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        if (!slabTest(node.lo, node.hi, ray.origin, invDir, tBest))
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                uint32_t arc = m_order[s];
+                uint32_t fiber = arc/FIBER_INDEX_ARCS;
+
+                // Tracing the whole circle only where the ray is inside the
+                // arc's box still finds the first hit: it lies in some box.
+                float enter, exit;
+                if (!slabInterval(m_lo[arc], m_hi[arc], ray.origin, invDir, tBest, enter, exit))
+                    continue;
+
+                float tHit = traceFiber(m_circles[fiber], m_radius, ray, enter, exit);
+
+                if (tHit >= 0 && tHit < tBest)
+                {
+                    tBest = tHit;
+                    picked = fiber;
+                }
+            }
+            continue;
+        }
+
+        uint32_t first = index + 1;
+        uint32_t second = node.offset;
+        if (ray.dir[node.axis] < 0)
+            std::swap(first, second);
+
+        stack[top++] = second;
+        stack[top++] = first;
+    }
+
+    t = tBest;
+    return picked;
+}
+
+uint32_t FiberIndex::nearest(vec3 p, float maxDistance, float& distance) const
+{
+    uint32_t closest = FIBER_BVH_MISS;
+    float best = maxDistance;
+
+    for (uint32_t fiber : m_lines)
+    {
+        float d = fiberDistance(m_circles[fiber], p);
+
+        if (d < best)
+        {
+            best = d;
+            closest = fiber;
+        }
+    }
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    if (!m_nodes.empty())
+        stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        // Boxes hold their arcs, so they bound the distance from below.
+        if (boxDistance(p, node.lo, node.hi) >= best)
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                uint32_t arc = m_order[s];
+                if (boxDistance(p, m_lo[arc], m_hi[arc]) >= best)
+                    continue;
+
+                float d = fiberDistance(m_circles[arc/FIBER_INDEX_ARCS], p);
+
+                if (d < best)
+                {
+                    best = d;
+                    closest = arc/FIBER_INDEX_ARCS;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child first, so best shrinks sooner.
+        uint32_t first = index + 1;
+        uint32_t second = node.offset;
+        if (boxDistance(p, m_nodes[first].lo, m_nodes[first].hi) > boxDistance(p, m_nodes[second].lo, m_nodes[second].hi))
+            std::swap(first, second);
+
+        stack[top++] = second;
+        stack[top++] = first;
+    }
+
+    distance = best;
+    return closest;
+}
+
+void FiberIndex::queryBox(vec3 lo, vec3 hi, std::vector<uint32_t>& fibers) const
+{
+    size_t first = fibers.size();
+
+    for (uint32_t fiber : m_lines)
+        if (fiberInBox(m_circles[fiber], lo, hi))
+            fibers.push_back(fiber);
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    if (!m_nodes.empty())
+        stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        if (!boxesOverlap(node.lo, node.hi, lo, hi))
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                uint32_t arc = m_order[s];
+                uint32_t fiber = arc/FIBER_INDEX_ARCS;
+
+                if (boxesOverlap(m_lo[arc], m_hi[arc], lo, hi) && fiberInBox(m_circles[fiber], lo, hi))
+                    fibers.push_back(fiber);
+            }
+            continue;
+        }
+
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+    }
+
+    uniqueFibers(fibers, first);
+}
+
+void FiberIndex::querySphere(vec3 center, float radius, std::vector<uint32_t>& fibers) const
+{
+    size_t first = fibers.size();
+
+    for (uint32_t fiber : m_lines)
+        if (fiberDistance(m_circles[fiber], center) <= radius)
+            fibers.push_back(fiber);
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    if (!m_nodes.empty())
+        stack[top++] = 0;
+
+    while (top)
+    {
+        uint32_t index = stack[--top];
+        const BVHNode& node = m_nodes[index];
+
+        if (boxDistance(center, node.lo, node.hi) > radius)
+            continue;
+
+        if (node.count)
+        {
+            for (uint32_t s = node.offset; s < node.offset + node.count; s++)
+            {
+                uint32_t arc = m_order[s];
+                uint32_t fiber = arc/FIBER_INDEX_ARCS;
+
+                if (boxDistance(center, m_lo[arc], m_hi[arc]) <= radius &&
+                    fiberDistance(m_circles[fiber], center) <= radius)
+                    fibers.push_back(fiber);
+            }
+            continue;
+        }
+
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+    }
+
+    uniqueFibers(fibers, first);
+}
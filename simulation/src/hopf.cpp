@@ -4,33 +4,46 @@
 
 #include <GL/gl.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <memory>
+#include <cstdio>
+#include <functional>
+#include <span>
+#include <string>
 #include <vector>
 
 #include "misc.h"
 #include "defines.h"
+#include "fiber.h"
 #include "mesh.h"
 #include "renderer.h"
+#include "sampling.h"
 #include "shader.h"
 
-
 /**********************************************************************************
  * 
  * Implementation details for SphereController
  * 
  **********************************************************************************/
 SphereController::SphereController(
-    std::shared_ptr<ShaderManager>& shaderManager, std::shared_ptr<SimulationParams>& params): 
+    std::shared_ptr<ShaderManager>& shaderManager, std::shared_ptr<SimulationParams>& params,
+    std::shared_ptr<GpuArena>& arena): 
+    m_arena(arena),
     m_params(params),
     m_shaderManager(shaderManager)
 {
-    auto sphereParam = [](float u, float v)
-    {
-        return S2(2*PI*v,PI*u);
-    };
+    m_points.setArena(m_arena.get(), "spheres/points");
+    m_basePoints.setArena(m_arena.get(), "spheres/points");
 
-    auto meshData = meshFromSurface(sphereParam,64,64,1,0);
-    m_sphereMesh.uploadData(meshData.first,meshData.second,GL_STREAM_DRAW);
+    m_meshGen.setShaderManager(m_shaderManager.get());
+}
+
+void SphereController::buildSphereMesh()
+{
+    // Same grid and topology meshFromSurface was given, evaluated on the GPU.
+    m_meshGen.surfaceMesh(m_sphereMesh, SURFACE_SPHERE, SPHERE_MESH_RES, SPHERE_MESH_RES, 1, 0);
 }
 
 void SphereController::render(Camera& camera)
@@ -43,6 +56,11 @@ void SphereController::render(Camera& camera)
     ShaderProgram shader = m_shaderManager->program("blinn-phong");
     ShaderProgram instanceShader= m_shaderManager->program("blinn-phong-instanced");
 
+    // Built here rather than in the constructor, which may run before the
+    // programs are linked.
+    if (!m_sphereMesh.indexCount())
+        buildSphereMesh();
+
     size_t indexCount = m_sphereMesh.indexCount();
 
     camera.bindUbo(0);
@@ -54,39 +72,121 @@ void SphereController::render(Camera& camera)
     shader.setUniform("scale",1.0f);
 
     // Render the little balls
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,m_points.id());
+    bufferHazards().prepare({bufferAccess(m_points, USAGE_STORAGE_READ)});
+    m_points.bind(GL_SHADER_STORAGE_BUFFER,0);
+
+    if (m_params->pointImpostors)
+    {
+        ShaderProgram impostor = m_shaderManager->program("sphere_impostor");
+
+        impostor.use();
+        impostor.setUniform("model",m_geometry,true);
+        impostor.setUniform("scale",0.04f);
+        impostor.setUniform("eye",vec3(glm::inverse(camera.getViewMatrix())[3]));
+        impostor.setUniform("highlight",m_highlight);
+
+        // Six vertices per point.
+        glState().bindVertexArray(m_emptyVao.get());
+        glDrawArrays(GL_TRIANGLES,0,6*m_params->maxFibers);
+        return;
+    }
+
     instanceShader.use();
     instanceShader.setUniform("model",m_geometry,true);
     instanceShader.setUniform("scale",0.04f);
+    instanceShader.setUniform("highlight",m_highlight);
     glDrawElementsInstanced(GL_TRIANGLES,indexCount,GL_UNSIGNED_INT,(void*)0,m_params->maxFibers);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
 
-    m_sphereMesh.unbindArray();
 }
 void SphereController::transform(mat4 trans) 
 {
     m_geometry = m_geometry*trans;
 }
 
-void SphereController::updateBallPositions()
+void SphereController::transformPoints(uint first, uint count)
 {
-    ShaderProgram computePositions = m_shaderManager->program("spheres_transform");
+    if (!count)
+        return;
+
+    // The barrier is left to whatever reads the points next.
+    RenderGraph graph;
+    RGResource points = graph.import("points", m_points);
+    RGResource basePoints = graph.import("base_points", m_basePoints);
+    graph.output(points);
 
-    uint sphereCount = (uint)(m_points.size()/sizeof(SpherePointData));
+    graph.addPass("spheres_transform", {{points, USAGE_STORAGE_WRITE}, {basePoints, USAGE_STORAGE_READ}}, [&](RenderGraph& graph)
+    {
+        ShaderProgram computePositions = m_shaderManager->program("spheres_transform");
+
+        graph.bind(GL_SHADER_STORAGE_BUFFER,0,points);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,1,basePoints);
+        computePositions.use();
+        computePositions.setUniform("first",first);
+        computePositions.setUniform("count",count);
+        computePositions.setUniform("u_rotation",m_rotation,GL_FALSE);
+        computePositions.dispatchCompute(count, 1, 1);
+    });
+
+    graph.execute();
+}
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,m_points.id());
-    computePositions.use();
-    computePositions.setUniform("count",sphereCount);
-    computePositions.setUniform("u_animSpeed",m_params->animSpeed);
-    computePositions.dispatchCompute(sphereCount, 1, 1);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
+bool SphereController::updateBallPositions(const mat3& rotation)
+{
+    if (rotation == m_rotation)
+        return false;
 
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    m_rotation = rotation;
+    transformPoints(0, (uint)(m_points.size()/sizeof(SpherePointData)));
+    return true;
 }
 
-void SphereController::uploadPointData(void* data, size_t size)
+void SphereController::uploadPointData(const void* data, size_t size)
 {
+    bufferHazards().prepare({bufferAccess(m_points, USAGE_UPDATE)});
+    this->m_basePoints.uploadData(data,size,GL_STATIC_DRAW);
     this->m_points.uploadData(data,size,GL_STREAM_DRAW);
+
+    auto points = static_cast<const SpherePointData*>(data);
+    m_basePointData.assign(points, points + size/sizeof(SpherePointData));
+
+    transformPoints(0, (uint)m_basePointData.size());
+}
+
+std::vector<uint> SphereController::updatePointData(const std::vector<SpherePointData>& points)
+{
+    std::vector<uint> changed;
+
+    if (points.size() != m_basePointData.size())
+    {
+        uploadPointData(points.data(), points.size()*sizeof(SpherePointData));
+
+        for (uint i = 0; i < points.size(); i++)
+            changed.push_back(i);
+        return changed;
+    }
+
+    // Upload and transform each run of changed points separately.
+    uint count = (uint)points.size();
+    for (uint i = 0; i < count;)
+    {
+        if (!memcmp(&points[i], &m_basePointData[i], sizeof(SpherePointData)))
+        {
+            i++;
+            continue;
+        }
+
+        uint first = i;
+        while (i < count && memcmp(&points[i], &m_basePointData[i], sizeof(SpherePointData)))
+        {
+            m_basePointData[i] = points[i];
+            changed.push_back(i++);
+        }
+
+        m_basePoints.uploadSubData(std::span(points).subspan(first, i - first), first*sizeof(SpherePointData), BUFFER_UPLOAD_INVALIDATE);
+        transformPoints(first, i - first);
+    }
+
+    return changed;
 }
 
 /**********************************************************************************
@@ -95,26 +195,56 @@ void SphereController::uploadPointData(void* data, size_t size)
  * 
  **********************************************************************************/
 
+// The fused kernel would otherwise truncate the fibers.
+static_assert(FIBER_SIZE <= FUSED_MAX_SAMPLES, "FIBER_SIZE exceeds the samples fiber_fused.comp holds in shared memory");
+
+// Start of the fiber list buffer, see fiber_compact.comp.
+struct FiberListHeader
+{
+    uint perSample[3];
+    uint perLine[3];
+    uint perTube[3];
+    uint count;
+};
+
  HopfFibrationDisplay::HopfFibrationDisplay(
-    std::shared_ptr<ShaderManager>& shaderManager, std::shared_ptr<SimulationParams>& params) :
- m_shaderManager(shaderManager), m_params(params)
+    std::shared_ptr<ShaderManager>& shaderManager, std::shared_ptr<SimulationParams>& params,
+    std::shared_ptr<GpuArena>& arena) :
+ m_arena(arena), m_graph(arena.get(), "fibers/transient"), m_shaderManager(shaderManager), m_params(params)
  {
-    circleData.reserveAttribs(FIBER_COUNT*FIBER_SIZE);
-    circleData.reserveIndices(FIBER_COUNT*FIBER_SIZE*6);
-    circleData.attribPointer(0, 4, GL_FLOAT, GL_FALSE, 0);
-    circleData.attribPointer(1, 4, GL_FLOAT, GL_FALSE, (void*)sizeof(vec4));  
-    circleData.attribPointer(2, 4, GL_FLOAT, GL_FALSE, (void*)(2*sizeof(vec4)));  
+    lineInstances.setArena(m_arena.get(), "fibers/instances");
+    dirtyBits.setArena(m_arena.get(), "fibers/dirty");
+    m_surface.setArena(m_arena.get(), "fibers/surface");
+    m_highlight.setArena(m_arena.get(), "fibers/highlight");
 
-    updateIndexData(0, 0);
+    // The tube meshes are only allocated once TUBES_MESH is drawn.
+    for (FiberGeometry& geometry : m_geometry)
+    {
+        PrimitiveData<Vertex>& circleData = geometry.circleData;
 
-    lineMeshData.reserveAttribs(FIBER_COUNT*FIBER_SIZE*m_params->lineDetail);
-    lineMeshData.reserveIndices(6*m_params->lineDetail*FIBER_COUNT*FIBER_SIZE);
+        circleData.setArena(m_arena.get(), "fibers/circles");
+        geometry.lineMeshData.setArena(m_arena.get(), "fibers/tubes");
 
-    lineMeshData.attribPointer(0,4,GL_FLOAT,GL_FALSE,0);
-    lineMeshData.attribPointer(1,4,GL_FLOAT,GL_FALSE,(void*)sizeof(vec4));
-    lineMeshData.attribPointer(2,4,GL_FLOAT,GL_FALSE,(void*)((2*sizeof(vec4))));
+        circleData.reserveAttribs(FIBER_COUNT*FIBER_SIZE);
+        circleData.reserveIndices(FIBER_COUNT*FIBER_SIZE*6);
+        circleData.attribPointer(0, 4, GL_FLOAT, GL_FALSE, 0);
+        circleData.attribPointer(1, 4, GL_FLOAT, GL_FALSE, (void*)sizeof(vec4));  
+        circleData.attribPointer(2, 4, GL_FLOAT, GL_FALSE, (void*)(2*sizeof(vec4)));  
+
+        geometry.dirtyBits.assign((FIBER_COUNT + 31)/32, 0);
+    }
+
+    updateIndexData(0, 0);
 
-    frameData.reserve(FIBER_COUNT*FIBER_SIZE*sizeof(TangentFrame));
+    // The GPU copy of the dirty bits starts, and is always left, cleared.
+    dirtyBits.uploadData(m_geometry[0].dirtyBits, GL_DYNAMIC_DRAW);
+ }
+
+ HopfFibrationDisplay::~HopfFibrationDisplay()
+ {
+    for (FiberGeometry& geometry : m_geometry)
+        if (geometry.drawFence)
+            glDeleteSync(geometry.drawFence);
  }
 
  void HopfFibrationDisplay::updateIndexData(const uint fiberCount, const uint fiberRes)
@@ -138,104 +268,466 @@ void SphereController::uploadPointData(void* data, size_t size)
     lineInstances.uploadData(instances);
  }
 
- void pipeline_polyline_mesh_compute(
-    GLuint in_lineData, 
-    GLuint in_instances, 
-    GLuint in_tangentFrameData, 
-    GLuint out_meshData, 
-    GLuint out_meshIndices,
+ /**
+  * Work group size tuning.  Kernels dispatched with the same indirect command
+  * must agree on their local size, so they are tuned as one group.  Each
+  * group is timed over the whole fiber update, with the other groups at
+  * their best sizes so far.
+  */
+ struct TuningGroup
+ {
+    const char* name;
+    std::vector<const char*> kernels;
+    bool fused;     // Timed with SimulationParams::fusedFibers set
+    std::vector<ShaderDefines> candidates;
+ };
 
-    uint numLines,
-    uint totalCount,
-    uint detail,
+ static const std::vector<TuningGroup>& tuningGroups()
+ {
+    static const std::vector<TuningGroup> groups = {
+        {"per_sample", {"hopf", "fiber_normals", "polyline_0_tangents"}, false,
+            {localSizeDefines(32), localSizeDefines(64), localSizeDefines(128), localSizeDefines(256)}},
+        {"per_line", {"polyline_1_normals"}, false,
+            {localSizeDefines(1,1,1), localSizeDefines(1,1,8), localSizeDefines(1,1,32), localSizeDefines(1,1,64)}},
+        {"per_tube", {"polyline_2_mesh"}, false,
+            {localSizeDefines(32,16), localSizeDefines(32,8), localSizeDefines(64,8), localSizeDefines(128,8), localSizeDefines(64,4)}},
+        {"fused", {"fiber_fused"}, true,
+            {localSizeDefines(32), localSizeDefines(64), localSizeDefines(128), localSizeDefines(256), localSizeDefines(512)}},
+    };
+    return groups;
+ }
+
+ ShaderProgram& HopfFibrationDisplay::kernel(const std::string& name, const ShaderDefines& extra)
+ {
+    ShaderDefines defines;
+
+    for (const TuningGroup& group : tuningGroups())
+        for (const char* member : group.kernels)
+            if (name == member && m_localSizes.count(group.name))
+                defines = m_localSizes[group.name];
+
+    // Tube kernels are specialised for one ring size.
+    if (name == "polyline_2_mesh" || name == "fiber_fused")
+        defines["LINE_DETAIL"] = std::to_string(m_params->lineDetail);
+
+    // The fused kernel holds a whole fiber in shared memory.
+    if (name == "fiber_fused")
+        defines["MAX_SAMPLES"] = std::to_string(FIBER_SIZE);
+
+    for (const auto& [define, value] : extra)
+        defines[define] = value;
+
+    return m_shaderManager->program(name, defines);
+ }
+
+ std::string HopfFibrationDisplay::tuningConfig() const
+ {
+    char config[64];
+    snprintf(config, sizeof(config), "fibers=%d samples=%d detail=%d", FIBER_COUNT, FIBER_SIZE, m_params->lineDetail);
+    return config;
+ }
+
+ void HopfFibrationDisplay::autotune(WorkGroupTuner& tuner)
+ {
+    // Nothing may still be drawing from the geometry overwritten below.
+    glFinish();
+
+    std::string config = tuningConfig();
+    bool fusedFibers = m_params->fusedFibers;
+    FiberGeometry& geometry = m_geometry[(m_front + 1) % FIBER_GEOMETRY_SETS];
+
+    for (const TuningGroup& group : tuningGroups())
+    {
+        m_params->fusedFibers = group.fused;
 
-    ShaderManager* shaderManager
-    )
+        ShaderDefines winner = tuner.tune(group.name, config, group.candidates, [&](const ShaderDefines& candidate)
+        {
+            m_localSizes[group.name] = candidate;
+
+            for (const char* member : group.kernels)
+                if (!kernel(member).valid())
+                    return false;
+
+            runFiberPasses(geometry, false, true, true);
+            return true;
+        });
+
+        if (winner.empty())
+            m_localSizes.erase(group.name);
+        else
+            m_localSizes[group.name] = winner;
+    }
+
+    m_params->fusedFibers = fusedFibers;
+    markAllDirty();
+ }
+
+ void HopfFibrationDisplay::applyTuning(const WorkGroupTuner& tuner)
+ {
+    std::string config = tuningConfig();
+
+    for (const TuningGroup& group : tuningGroups())
+        if (const ShaderDefines* defines = tuner.best(group.name, config))
+            m_localSizes[group.name] = *defines;
+ }
+
+ /**
+  * Dispatch a fiber pass over countZ fibers or, if fiberList is non-zero,
+  * indirectly over the compacted list using the command at offset.  The
+  * program must already be in use.
+  */
+ static void dispatchLines(ShaderProgram& program, uint countX, uint countY, uint countZ, GLuint fiberList, GLintptr offset)
+ {
+    program.setUniform("u_useFiberList",(int)(fiberList != 0));
+
+    if (fiberList)
+        program.dispatchComputeIndirect(fiberList, offset);
+    else
+        program.dispatchCompute(countX, countY, countZ);
+ }
+
+void HopfFibrationDisplay::markFiberDirty(uint fiber)
 {
-    ShaderProgram polylineTangets = shaderManager->program("polyline_0_tangents");
-    ShaderProgram polylineNormals = shaderManager->program("polyline_1_normals");
-    ShaderProgram polylineMesh = shaderManager->program("polyline_2_mesh");
-
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,in_lineData);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,in_instances);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,in_tangentFrameData);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,out_meshData);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,4,out_meshIndices);
-
-    polylineTangets.use();
-    polylineTangets.setUniform("numLines",(uint)numLines);
-    polylineTangets.dispatchCompute(FIBER_SIZE, 1, numLines);
-
-    polylineNormals.use();
-    polylineNormals.setUniform("numLines",(uint)numLines);
-    polylineNormals.dispatchCompute(1, 1, numLines);
-
-    polylineMesh.use();
-    polylineMesh.setUniform("numLines",(uint)numLines);
-    polylineMesh.setUniform("lineDetail",(uint)detail);
-    polylineMesh.dispatchCompute(FIBER_SIZE,detail,FIBER_COUNT);
-
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,4,0);
+    for (FiberGeometry& geometry : m_geometry)
+    for (uint neighbour : {fiber + FIBER_COUNT - 1, fiber, fiber + 1})
+    {
+        uint i = neighbour % FIBER_COUNT;
+        size_t word = i/32;
+
+        geometry.dirtyBits[word] |= 1u << (i % 32);
+
+        if (geometry.dirtyBegin == geometry.dirtyEnd)
+        {
+            geometry.dirtyBegin = word;
+            geometry.dirtyEnd = word + 1;
+        }
+        else
+        {
+            geometry.dirtyBegin = std::min(geometry.dirtyBegin, word);
+            geometry.dirtyEnd = std::max(geometry.dirtyEnd, word + 1);
+        }
+    }
 }
 
- void HopfFibrationDisplay::updateFiberData()
- {
-    ShaderProgram hopf_map = m_shaderManager->program("hopf");
-    
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,spherePoints->id());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,lineInstances.id());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,circleData.vbo()->id());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,circleData.ebo()->id());
+bool HopfFibrationDisplay::drawCircleMesh() const
+{
+    return m_params->drawMesh && samplingIsCurve(m_params->sampling);
+}
+
+void HopfFibrationDisplay::markAllDirty()
+{
+    for (FiberGeometry& geometry : m_geometry)
+        geometry.allDirty = true;
+}
+
+void HopfFibrationDisplay::updateFiberData()
+{
+    // Moving fibers are generated over other points.
+    if (m_params->fiberMotion != m_moving)
+    {
+        m_moving = m_params->fiberMotion;
+        markAllDirty();
+    }
+
+    // Without the mesh the unfused passes leave the normals out.
+    if (drawCircleMesh() != m_meshNormals)
+    {
+        m_meshNormals = drawCircleMesh();
+        if (m_meshNormals)
+            markAllDirty();
+    }
+
+    bool surfaceStale = m_surfaceDirty || m_surfaceTolerance != m_params->surfaceTolerance;
+
+    if (m_params->drawSurface && m_surfaceCurve && surfaceStale)
+        updateSurface();
+
+    // Impostors and lines are drawn straight from the circle samples.
+    bool meshTubes = m_params->tubeMode == TUBES_MESH;
+    bool circles = drawCircleMesh() || (m_params->drawLines && !meshTubes);
+    bool tubes = m_params->drawLines && meshTubes;
+
+    // Every change is marked in all sets, so a clean front set with all that
+    // is drawn means nothing changed since it was generated.
+    const FiberGeometry& front = m_geometry[m_front];
+
+    if (!front.allDirty && front.dirtyBegin == front.dirtyEnd && front.has(circles, tubes))
+        return;
+
+    // The back set also carries the changes it missed while it was drawn.
+    // Geometry that was culled when it was generated is stale throughout.
+    uint backIndex = (m_front + 1) % FIBER_GEOMETRY_SETS;
+    FiberGeometry& back = m_geometry[backIndex];
+    bool partial = !back.allDirty && back.has(circles, tubes);
+
+    // Only the GPU waits for the draws still reading this set, in place of a
+    // storage barrier; it is free to overlap them with the work below, which
+    // touches the other set.
+    if (back.drawFence)
+    {
+        glWaitSync(back.drawFence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(back.drawFence);
+        back.drawFence = 0;
 
-    hopf_map.use();
-    hopf_map.setUniform("numFibers",(unsigned int)FIBER_COUNT);
-    hopf_map.setUniform("tOffset",(float)m_params->tOffset);
-    hopf_map.dispatchCompute(FIBER_COUNT, FIBER_SIZE, 1);
+        BufferHazards& hazards = bufferHazards();
+        for (PrimitiveData<Vertex>* data : {&back.circleData, &back.lineMeshData})
+        {
+            hazards.retired(bufferAccess(*data->vbo(), 0));
+            hazards.retired(bufferAccess(*data->ebo(), 0));
+        }
+    }
 
-	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    runFiberPasses(back, partial, circles, tubes);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,0);
+    std::fill(back.dirtyBits.begin() + back.dirtyBegin, back.dirtyBits.begin() + back.dirtyEnd, 0);
+    back.dirtyBegin = back.dirtyEnd = 0;
+    back.allDirty = false;
+    back.hasCircles = circles;
+    back.hasTubes = tubes;
 
-    ShaderProgram compute_normals = m_shaderManager->program("mesh_normals");
+    m_front = backIndex;
+}
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,circleData.vbo()->id());
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,circleData.ebo()->id());
+RGResource HopfFibrationDisplay::addCompactPasses(RenderGraph& graph, FiberGeometry& geometry, bool fused)
+{
+    RGResource bits = graph.import("dirty_bits", dirtyBits);
+    RGResource list = graph.transient("fiber_list", sizeof(FiberListHeader) + FIBER_COUNT*sizeof(uint));
 
-    uint numTriangles = circleData.ebo()->size()/(3*sizeof(uint));
+    // The fused kernel also runs one group per fiber, so it takes the
+    // per-line command in place of polyline_1_normals.
+    GLint perSample[3], perLine[3], perTube[3];
+    kernel("hopf").workGroupSize(perSample);
+    kernel(fused ? "fiber_fused" : "polyline_1_normals").workGroupSize(perLine);
+    kernel("polyline_2_mesh").workGroupSize(perTube);
 
-    compute_normals.use();
-    compute_normals.setUniform("numTriangles",numTriangles);
-    compute_normals.dispatchCompute(numTriangles, 1, 1);
+    // x and y match a full dispatch; z is filled in by fiber_compact.
+    FiberListHeader header = {
+        .perSample = {(FIBER_SIZE - 1)/(uint)perSample[0] + 1, 1, 0},
+        .perLine   = {1, 1, 0},
+        .perTube   = {(FIBER_SIZE - 1)/(uint)perTube[0] + 1, ((uint)m_params->lineDetail - 1)/(uint)perTube[1] + 1, 0},
+        .count = 0
+    };
 
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    uint wordOffset = (uint)geometry.dirtyBegin;
+    uint wordCount = (uint)(geometry.dirtyEnd - geometry.dirtyBegin);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,0);
+    graph.addPass("fiber_list_upload", {{bits, USAGE_UPDATE}, {list, USAGE_UPDATE}}, [=, this, &geometry](RenderGraph& graph)
+    {
+        graph.upload(list, &header, sizeof(header));
+        dirtyBits.uploadSubData(std::span(geometry.dirtyBits).subspan(wordOffset, wordCount), wordOffset*sizeof(uint32_t), BUFFER_UPLOAD_INVALIDATE);
+    });
+
+    // Also clears the dirty bits it reads.
+    graph.addPass("fiber_compact", {{bits, USAGE_STORAGE_READ | USAGE_STORAGE_WRITE}, {list, USAGE_STORAGE_READ | USAGE_STORAGE_WRITE}}, [=, this](RenderGraph& graph)
+    {
+        ShaderProgram compact = m_shaderManager->program("fiber_compact");
 
-    // Generate meshes for the big circles
+        graph.bind(GL_SHADER_STORAGE_BUFFER,6,bits);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,7,list);
 
-    pipeline_polyline_mesh_compute(
-        circleData.vbo()->id(),
-        lineInstances.id(),
-        frameData.id(),
-        lineMeshData.vbo()->id(),
-        lineMeshData.ebo()->id(),
+        compact.use();
+        compact.setUniform("wordOffset",wordOffset);
+        compact.setUniform("wordCount",wordCount);
+        compact.setUniform("groupZPerSample",(uint)perSample[2]);
+        compact.setUniform("groupZPerLine",(uint)perLine[2]);
+        compact.setUniform("groupZPerTube",(uint)perTube[2]);
+        compact.dispatchCompute(wordCount, 1, 1);
+    });
 
-        FIBER_COUNT,
-        FIBER_SIZE,
-        m_params->lineDetail,
-        
-        m_shaderManager.get()
-    );
+    return list;
+}
+
+void HopfFibrationDisplay::reserveTubeMesh(FiberGeometry& geometry)
+{
+    PrimitiveData<Vertex>& lineMeshData = geometry.lineMeshData;
+    size_t vertices = FIBER_COUNT*FIBER_SIZE*m_params->lineDetail;
+
+    if (lineMeshData.vbo()->capacity() >= vertices*sizeof(Vertex))
+        return;
+
+    lineMeshData.reserveAttribs(vertices);
+    lineMeshData.reserveIndices(6*vertices);
+
+    lineMeshData.attribPointer(0,4,GL_FLOAT,GL_FALSE,0);
+    lineMeshData.attribPointer(1,4,GL_FLOAT,GL_FALSE,(void*)sizeof(vec4));
+    lineMeshData.attribPointer(2,4,GL_FLOAT,GL_FALSE,(void*)((2*sizeof(vec4))));
+}
+
+void HopfFibrationDisplay::runFiberPasses(FiberGeometry& geometry, bool partial, bool circles, bool tubes)
+{
+    if (tubes)
+        reserveTubeMesh(geometry);
+
+    RenderGraph& graph = m_graph;
+    PrimitiveData<Vertex>& circleData = geometry.circleData;
+    PrimitiveData<Vertex>& lineMeshData = geometry.lineMeshData;
+
+    RGResource points        = graph.import("points", m_moving ? *baseSpherePoints : *spherePoints);
+    RGResource instances     = graph.import("line_instances", lineInstances);
+    RGResource circleVerts   = graph.import("circle_vertices", *circleData.vbo());
+    RGResource circleIndices = graph.import("circle_indices", *circleData.ebo());
+    RGResource tubeVerts     = graph.import("tube_vertices", *lineMeshData.vbo());
+    RGResource tubeIndices   = graph.import("tube_indices", *lineMeshData.ebo());
+
+    if (circles)
+    {
+        graph.output(circleVerts);
+        graph.output(circleIndices);
+    }
+    if (tubes)
+    {
+        graph.output(tubeVerts);
+        graph.output(tubeIndices);
+    }
+
+    // A fused variant that failed to build leaves the unfused passes.
+    ShaderProgram fused = {0};
+    if (m_params->fusedFibers)
+        fused = tubes ? kernel("fiber_fused") : kernel("fiber_fused", {{"NO_TUBES", "1"}});
+    bool useFused = fused.valid();
+
+    // On partial updates every fiber pass is dispatched over the list.
+    RGResource list = partial ? addCompactPasses(graph, geometry, useFused) : 0;
+
+    auto fiberPass = [&](std::vector<PassAccess> accesses)
+    {
+        if (partial)
+            accesses.push_back({list, USAGE_STORAGE_READ | USAGE_INDIRECT});
+        return accesses;
+    };
+    auto bindList = [partial, list](RenderGraph& graph)
+    {
+        if (partial)
+            graph.bind(GL_SHADER_STORAGE_BUFFER,7,list);
+    };
+    auto dispatch = [partial, list](RenderGraph& graph, ShaderProgram& program, uint countX, uint countY, GLintptr command)
+    {
+        if (partial)
+            dispatchLines(program, countX, countY, FIBER_COUNT, graph.buffer(list), graph.offset(list) + command);
+        else
+            dispatchLines(program, countX, countY, FIBER_COUNT, 0, 0);
+    };
+
+    if (useFused)
+    {
+        // Without tubes, a variant that skips the frames and the tube mesh
+        // and leaves the tube buffers alone.
+        std::vector<PassAccess> accesses = {
+            {points, USAGE_STORAGE_READ}, {instances, USAGE_STORAGE_READ},
+            {circleVerts, USAGE_STORAGE_WRITE}, {circleIndices, USAGE_STORAGE_WRITE}};
+        if (tubes)
+            accesses.insert(accesses.end(), {{tubeVerts, USAGE_STORAGE_WRITE}, {tubeIndices, USAGE_STORAGE_WRITE}});
+
+        graph.addPass("fiber_fused", fiberPass(accesses), [&](RenderGraph& graph)
+        {
+            graph.bind(GL_SHADER_STORAGE_BUFFER,0,points);
+            graph.bind(GL_SHADER_STORAGE_BUFFER,1,instances);
+            graph.bind(GL_SHADER_STORAGE_BUFFER,2,circleVerts);
+            graph.bind(GL_SHADER_STORAGE_BUFFER,3,circleIndices);
+            if (tubes)
+            {
+                graph.bind(GL_SHADER_STORAGE_BUFFER,4,tubeVerts);
+                graph.bind(GL_SHADER_STORAGE_BUFFER,5,tubeIndices);
+            }
+            bindList(graph);
+
+            fused.use();
+            fused.setUniform("numFibers",(unsigned int)FIBER_COUNT);
+            fused.setUniform("lineDetail",(uint)m_params->lineDetail);
+            dispatch(graph, fused, 1, 1, offsetof(FiberListHeader, perLine));
+        });
+
+        graph.execute();
+        return;
+    }
+
+    graph.addPass("hopf", fiberPass({
+        {points, USAGE_STORAGE_READ}, {instances, USAGE_STORAGE_READ},
+        {circleVerts, USAGE_STORAGE_WRITE}, {circleIndices, USAGE_STORAGE_WRITE}}), [&](RenderGraph& graph)
+    {
+        ShaderProgram hopf_map = kernel("hopf");
+
+        graph.bind(GL_SHADER_STORAGE_BUFFER,0,points);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,1,instances);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,2,circleVerts);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,3,circleIndices);
+        bindList(graph);
+
+        hopf_map.use();
+        hopf_map.setUniform("numFibers",(unsigned int)FIBER_COUNT);
+        dispatch(graph, hopf_map, FIBER_SIZE, 1, offsetof(FiberListHeader, perSample));
+    });
+
+    // Normals come from the mesh to the next fiber, so they are only of use
+    // where that mesh is drawn.
+    if (drawCircleMesh())
+    {
+        graph.addPass("fiber_normals", fiberPass({
+            {circleVerts, USAGE_STORAGE_READ | USAGE_STORAGE_WRITE}, {instances, USAGE_STORAGE_READ}}), [&](RenderGraph& graph)
+        {
+            ShaderProgram compute_normals = kernel("fiber_normals");
+
+            graph.bind(GL_SHADER_STORAGE_BUFFER,0,circleVerts);
+            graph.bind(GL_SHADER_STORAGE_BUFFER,1,instances);
+            bindList(graph);
+
+            compute_normals.use();
+            compute_normals.setUniform("numFibers",(unsigned int)FIBER_COUNT);
+            dispatch(graph, compute_normals, FIBER_SIZE, 1, offsetof(FiberListHeader, perSample));
+        });
+    }
+
+    // Generate meshes for the big circles.  The tangent frames are only
+    // needed between the polyline passes.
+    RGResource frames = graph.transient("frame_data", FIBER_COUNT*FIBER_SIZE*sizeof(TangentFrame));
+
+    auto bindPolyline = [&](RenderGraph& graph)
+    {
+        graph.bind(GL_SHADER_STORAGE_BUFFER,0,circleVerts);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,1,instances);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,2,frames);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,3,tubeVerts);
+        graph.bind(GL_SHADER_STORAGE_BUFFER,4,tubeIndices);
+        bindList(graph);
+    };
+
+    graph.addPass("polyline_0_tangents", fiberPass({
+        {circleVerts, USAGE_STORAGE_READ}, {instances, USAGE_STORAGE_READ},
+        {frames, USAGE_STORAGE_WRITE}}), [&](RenderGraph& graph)
+    {
+        ShaderProgram polylineTangents = kernel("polyline_0_tangents");
+        bindPolyline(graph);
+
+        polylineTangents.use();
+        polylineTangents.setUniform("numLines",(uint)FIBER_COUNT);
+        dispatch(graph, polylineTangents, FIBER_SIZE, 1, offsetof(FiberListHeader, perSample));
+    });
+
+    graph.addPass("polyline_1_normals", fiberPass({
+        {instances, USAGE_STORAGE_READ}, {frames, USAGE_STORAGE_READ | USAGE_STORAGE_WRITE}}), [&](RenderGraph& graph)
+    {
+        ShaderProgram polylineNormals = kernel("polyline_1_normals");
+        bindPolyline(graph);
+
+        polylineNormals.use();
+        polylineNormals.setUniform("numLines",(uint)FIBER_COUNT);
+        dispatch(graph, polylineNormals, 1, 1, offsetof(FiberListHeader, perLine));
+    });
+
+    graph.addPass("polyline_2_mesh", fiberPass({
+        {circleVerts, USAGE_STORAGE_READ}, {instances, USAGE_STORAGE_READ}, {frames, USAGE_STORAGE_READ},
+        {tubeVerts, USAGE_STORAGE_WRITE}, {tubeIndices, USAGE_STORAGE_WRITE}}), [&](RenderGraph& graph)
+    {
+        ShaderProgram polylineMesh = kernel("polyline_2_mesh");
+        bindPolyline(graph);
+
+        polylineMesh.use();
+        polylineMesh.setUniform("numLines",(uint)FIBER_COUNT);
+        polylineMesh.setUniform("lineDetail",(uint)m_params->lineDetail);
+        dispatch(graph, polylineMesh, FIBER_SIZE, m_params->lineDetail, offsetof(FiberListHeader, perTube));
+    });
+
+    graph.execute();
 }
 
 void HopfFibrationDisplay::render(Camera& camera)
@@ -252,38 +744,343 @@ void HopfFibrationDisplay::render(Camera& camera)
     shader.setUniform("model",mat4(1.0f),GL_FALSE);
     shader.setUniform("scale",1.0f);
     shader.setUniform("t",(float)glfwGetTime());
+    setMotionUniforms(shader, m_moving);
+
+    FiberGeometry& geometry = m_geometry[m_front];
+    PrimitiveData<Vertex>& circleData = geometry.circleData;
+    PrimitiveData<Vertex>& lineMeshData = geometry.lineMeshData;
+
+    // One barrier for whatever generation left unflushed.
+    std::vector<BufferAccess> drawn;
+    if (drawCircleMesh())
+        drawn.insert(drawn.end(), {
+            bufferAccess(*circleData.vbo(), USAGE_VERTEX),
+            bufferAccess(*circleData.ebo(), USAGE_INDEX)});
+    if (m_params->drawLines && m_params->tubeMode == TUBES_MESH)
+        drawn.insert(drawn.end(), {
+            bufferAccess(*lineMeshData.vbo(), USAGE_VERTEX),
+            bufferAccess(*lineMeshData.ebo(), USAGE_INDEX)});
+    bufferHazards().prepare(drawn);
     
-    if (m_params->drawMesh)
+    if (drawCircleMesh())
     {
         circleData.bindArray();
-        glDrawElements(GL_TRIANGLES, 6*m_params->maxFibers*FIBER_SIZE, GL_UNSIGNED_INT, 0);
-        circleData.unbindArray();
+        glDrawElements(GL_TRIANGLES, 6*m_params->maxFibers*FIBER_SIZE, GL_UNSIGNED_INT, circleData.indexOffset());
     }
 
-    if (m_params->drawLines)
+    if (m_params->drawLines && m_params->tubeMode == TUBES_MESH)
     {
         lineMeshData.bindArray();
-        glDrawElements(GL_TRIANGLES,6*m_params->lineDetail*FIBER_SIZE*m_params->maxFibers,GL_UNSIGNED_INT,0);
-        lineMeshData.unbindArray();
+        glDrawElements(GL_TRIANGLES,6*m_params->lineDetail*FIBER_SIZE*m_params->maxFibers,GL_UNSIGNED_INT,lineMeshData.indexOffset());
+    }
+
+    if (m_params->drawSurface && m_surfaceIndices)
+    {
+        ShaderProgram surface = m_shaderManager->program("blinn-phong");
+
+        // The surface is seen from both sides.  Its mesh is never rotated,
+        // so it is moved whether or not the fibers are.
+        surface.use();
+        surface.setUniform("model",mat4(1.0f),GL_FALSE);
+        surface.setUniform("scale",1.0f);
+        surface.setUniform("twoSided",1);
+        setMotionUniforms(surface, true);
+
+        m_surface.bindArray();
+        glDrawElements(GL_TRIANGLES,m_surfaceIndices,GL_UNSIGNED_INT,m_surface.indexOffset());
+
+        // The program is shared with the control sphere.
+        surface.setUniform("twoSided",0);
+        setMotionUniforms(surface, false);
+    }
+
+    if (m_params->drawLines && m_params->tubeMode == TUBES_IMPOSTOR)
+        renderImpostors(camera, geometry);
+
+    if (m_params->drawLines && m_params->tubeMode == TUBES_LINES)
+        renderLines(geometry);
+
+    if (m_highlighted)
+    {
+        if (m_highlightDirty)
+            updateHighlight();
+
+        ShaderProgram highlight = m_shaderManager->program("blinn-phong");
+
+        // The tube is built where the fiber is drawn, so it is not moved.
+        highlight.use();
+        highlight.setUniform("model",mat4(1.0f),GL_FALSE);
+        highlight.setUniform("scale",1.0f);
+        setMotionUniforms(highlight, false);
+
+        if (m_highlightIndices)
+        {
+            m_highlight.bindArray();
+            glDrawElements(GL_TRIANGLES,m_highlightIndices,GL_UNSIGNED_INT,m_highlight.indexOffset());
+        }
     }
     
-    glBindBufferBase(GL_UNIFORM_BUFFER,0,0);
 
-    ShaderProgram reset_normals = m_shaderManager->program("mesh_normals_reset");
+    // Tiled rendering draws a set several times; fence the last draw.
+    if (geometry.drawFence)
+        glDeleteSync(geometry.drawFence);
+    geometry.drawFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void HopfFibrationDisplay::bindSamples(FiberGeometry& geometry)
+{
+    Buffer& samples = *geometry.circleData.vbo();
+
+    bufferHazards().prepare({
+        bufferAccess(samples, USAGE_STORAGE_READ),
+        bufferAccess(lineInstances, USAGE_STORAGE_READ)});
+
+    samples.bind(GL_SHADER_STORAGE_BUFFER,0);
+    lineInstances.bind(GL_SHADER_STORAGE_BUFFER,1);
+}
+
+void HopfFibrationDisplay::renderImpostors(Camera& camera, FiberGeometry& geometry)
+{
+    ShaderProgram impostor = m_shaderManager->program("fiber_impostor");
+    bindSamples(geometry);
+
+    mat4 view = camera.getViewMatrix();
+    mat4 pv = camera.getProjMatrix()*view;
+
+    impostor.use();
+    impostor.setUniform("fiberSize",(uint)FIBER_SIZE);
+    impostor.setUniform("invPV",glm::inverse(pv),GL_FALSE);
+    impostor.setUniform("eye",vec3(glm::inverse(view)[3]));
+    setMotionUniforms(impostor, m_moving);
+
+    // Six vertices per segment, one segment per sample slot.
+    glState().bindVertexArray(m_emptyVao.get());
+    glDrawArrays(GL_TRIANGLES, 0, 6*m_params->maxFibers*FIBER_SIZE);
+}
+
+void HopfFibrationDisplay::renderLines(FiberGeometry& geometry)
+{
+    ShaderProgram lines = m_shaderManager->program("fiber_lines");
+    bindSamples(geometry);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,circleData.vbo()->id());
+    lines.use();
+    lines.setUniform("fiberSize",(uint)FIBER_SIZE);
+    lines.setUniform("viewport",vec2(viewport[2],viewport[3]));
+    lines.setUniform("lineWidth",m_params->lineWidth*m_params->pixelScale);
+    lines.setUniform("lineAlpha",m_params->lineAlpha);
+    setMotionUniforms(lines, m_moving);
 
-    reset_normals.use();
-    reset_normals.setUniform("count",FIBER_COUNT*FIBER_SIZE);
-    reset_normals.dispatchCompute(FIBER_COUNT*FIBER_SIZE, 1, 1);
+    // Additive lines are order independent, so they need no depth writes;
+    // the depth test still hides them behind the circle mesh.
+    glEnable(GL_BLEND);
+    if (m_params->lineAdditive)
+    {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        glDepthMask(GL_FALSE);
+    }
+    else
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    // Six vertices per segment, one segment per sample slot.
+    glState().bindVertexArray(m_emptyVao.get());
+    glDrawArrays(GL_TRIANGLES, 0, 6*m_params->maxFibers*FIBER_SIZE);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
 }
 
-void HopfFibrationDisplay::setPoints(const Buffer& points)
+void HopfFibrationDisplay::setPoints(const Buffer& points, const Buffer& basePoints)
 {
     this->spherePoints = &points;
+    this->baseSpherePoints = &basePoints;
+}
+
+void HopfFibrationDisplay::setRotation(const mat3& rotation)
+{
+    if (rotation == m_rotation)
+        return;
+
+    m_rotation = rotation;
+    m_motion = fiberMotion(rotation);
+
+    // Moving fibers stay as generated.
+    if (!m_params->fiberMotion)
+        markAllDirty();
+}
+
+void HopfFibrationDisplay::setMotionUniforms(ShaderProgram& program, bool moving)
+{
+    program.setUniform("u_useMotion",(int)moving);
+    if (moving)
+        program.setUniform("u_motion",m_motion,GL_FALSE);
+}
+
+void HopfFibrationDisplay::highlightFiber(vec3 point)
+{
+    if (m_highlighted && point == m_highlightPoint)
+        return;
+
+    m_highlightPoint = point;
+    m_highlighted = true;
+    m_highlightDirty = true;
+}
+
+void HopfFibrationDisplay::updateHighlight()
+{
+    FiberCircle<float> circle = fiberCircle(m_highlightPoint);
+
+    std::vector<Vertex> vertices;
+    std::vector<uint> indices;
+
+    if (!circle.isLine)
+    {
+        const vec4 color = vec4(1);
+
+        // Rings of HIGHLIGHT_SIDES vertices around the circle, each in the
+        // plane spanned by the circle's radial direction and normal.
+        for (uint i = 0; i < HIGHLIGHT_SEGMENTS; i++)
+        {
+            float t = 2*PI*(float)i/HIGHLIGHT_SEGMENTS;
+            vec3 radial = std::cos(t)*circle.axis + std::sin(t)*circle.binormal;
+            vec3 center = circle.center + circle.radius*radial;
+
+            for (uint j = 0; j < HIGHLIGHT_SIDES; j++)
+            {
+                float a = 2*PI*(float)j/HIGHLIGHT_SIDES;
+                vec3 normal = std::cos(a)*radial + std::sin(a)*circle.normal;
+                vertices.push_back({vec4(center + HIGHLIGHT_RADIUS*normal,1), color, vec4(normal,0)});
+            }
+        }
+
+        for (uint i = 0; i < HIGHLIGHT_SEGMENTS; i++)
+        {
+            uint ring = i*HIGHLIGHT_SIDES;
+            uint next = ((i + 1) % HIGHLIGHT_SEGMENTS)*HIGHLIGHT_SIDES;
+
+            for (uint j = 0; j < HIGHLIGHT_SIDES; j++)
+            {
+                uint k = (j + 1) % HIGHLIGHT_SIDES;
+                indices.insert(indices.end(), {ring + j, next + j, next + k, ring + j, next + k, ring + k});
+            }
+        }
+
+        m_highlight.uploadData(vertices, indices, GL_DYNAMIC_DRAW);
+
+        // Growing may have moved the vertices within the arena.
+        m_highlight.attribPointer(0,4,GL_FLOAT,GL_FALSE,0);
+        m_highlight.attribPointer(1,4,GL_FLOAT,GL_FALSE,(void*)sizeof(vec4));
+        m_highlight.attribPointer(2,4,GL_FLOAT,GL_FALSE,(void*)(2*sizeof(vec4)));
+    }
+
+    m_highlightIndices = indices.size();
+    m_highlightDirty = false;
+}
+
+void HopfFibrationDisplay::setSurfaceCurve(std::function<vec3(float)> curve)
+{
+    m_surfaceCurve = std::move(curve);
+    m_surfaceDirty = true;
+}
+
+void HopfFibrationDisplay::updateSurface()
+{
+    HopfSurfaceOptions options;
+    options.tolerance = m_params->surfaceTolerance;
+
+    // Always over the unrotated curve; render moves it in S3.
+    std::vector<Vertex> vertices;
+    std::vector<uint> indices;
+
+    hopfSurface(m_surfaceCurve, options, vertices, indices);
+
+    m_surface.uploadData(vertices, indices, GL_DYNAMIC_DRAW);
+
+    // Growing may have moved the vertices within the arena.
+    m_surface.attribPointer(0,4,GL_FLOAT,GL_FALSE,0);
+    m_surface.attribPointer(1,4,GL_FLOAT,GL_FALSE,(void*)sizeof(vec4));
+    m_surface.attribPointer(2,4,GL_FLOAT,GL_FALSE,(void*)(2*sizeof(vec4)));
+
+    m_surfaceVertices = vertices.size();
+    m_surfaceIndices = indices.size();
+    m_surfaceTolerance = m_params->surfaceTolerance;
+    m_surfaceDirty = false;
+}
+
+/**********************************************************************************
+ * 
+ * Shader programs
+ * 
+ **********************************************************************************/
+
+bool addHopfPrograms(ShaderManager& shaderManager)
+{
+    // Every program is tried, so all failures are reported at once.
+    bool ok = true;
+
+    ok &= shaderManager.addProgram(
+    "default",           
+    {"default.vert","solid_color.frag"});
+
+    ok &= shaderManager.addProgram(
+    "blinn-phong",       
+    {"default.vert","blinnphong.frag"});
+
+    ok &= shaderManager.addProgram(
+    "blinn-phong-instanced", 
+    {"spheres_instanced.vert","blinnphong.frag"});
+
+    ok &= shaderManager.addProgram(
+    "polyline_0_tangents",              
+    {"polyline_0_tangents.comp"});
+
+    ok &= shaderManager.addProgram(
+    "polyline_1_normals",              
+    {"polyline_1_normals.comp"});
+
+    ok &= shaderManager.addProgram(
+    "polyline_2_mesh",              
+    {"polyline_2_mesh.comp"});
+
+    ok &= shaderManager.addProgram(
+    "hopf",                  
+    {"hopf.comp"});
+
+    ok &= shaderManager.addProgram(
+    "spheres_transform",                
+    {"spheres_transform.comp"});
+
+    ok &= shaderManager.addProgram(
+    "fiber_normals", 
+    {"fiber_normals.comp"});
+
+    ok &= shaderManager.addProgram(
+    "fiber_compact", 
+    {"fiber_compact.comp"});
+
+    ok &= shaderManager.addProgram(
+    "fiber_fused", 
+    {"fiber_fused.comp"});
+
+    ok &= shaderManager.addProgram(
+    "fiber_impostor", 
+    {"fiber_impostor.vert","fiber_impostor.frag"});
+
+    ok &= shaderManager.addProgram(
+    "fiber_lines", 
+    {"fiber_lines.vert","fiber_lines.frag"});
+
+    ok &= shaderManager.addProgram(
+    "sphere_impostor", 
+    {"sphere_impostor.vert","sphere_impostor.frag"});
+
+    ok &= shaderManager.addProgram(
+    "surface_mesh", 
+    {"surface_mesh.comp"});
+
+    if (!ok)
+        fprintf(stderr, "ERROR: could not build the hopf shader programs\n");
+    return ok;
 }
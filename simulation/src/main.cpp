@@ -1,17 +1,51 @@
 #include "simulation.h"
+#include "batch.h"
+#include "poster.h"
+#include "pathtracer.h"
+
+#include <cstring>
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
 #define WIN_X 400
 #define WIN_Y 400
 
-int main()
+int main(int argc, char** argv)
 {
+    // Offline rendering forks its own workers, so it must run before GLFW
+    // is initialised here.
+    if (argc > 1 && !strcmp(argv[1],"--batch"))
+    {
+        BatchOptions options;
+        if (!parseBatchOptions(argc, argv, options))
+            return 1;
+        return runBatchRender(options);
+    }
+
+    if (argc > 1 && !strcmp(argv[1],"--poster"))
+    {
+        PosterOptions options;
+        if (!parsePosterOptions(argc, argv, options))
+            return 1;
+        return runPosterRender(options);
+    }
+
+    // Needs no GL context at all, so it runs on machines without a GPU.
+    if (argc > 1 && !strcmp(argv[1],"--trace"))
+    {
+        TraceOptions options;
+        if (!parseTraceOptions(argc, argv, options))
+            return 1;
+        return runTraceRender(options);
+    }
+
+    bool autotune = argc > 1 && !strcmp(argv[1],"--autotune");
+
     if (!glfwInit()) {
 		fprintf(stderr, "ERROR: could not start GLFW3\n");
     }
 
-    HopfSimulation sim("Hopf Simulation", WINDOW_WIDTH,WINDOW_HEIGHT,WIN_X,WIN_Y);
+    HopfSimulation sim("Hopf Simulation", WINDOW_WIDTH,WINDOW_HEIGHT,WIN_X,WIN_Y,autotune);
 
     glfwTerminate();
     return 0;
@@ -0,0 +1,333 @@
+#include "offscreen.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+// Only surfaceless displays are used, so leave out the X11 types.
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "glstate.h"
+#include "rendergraph.h"
+#include "sampling.h"
+
+/**********************************************************************************
+ *
+ * Headless context
+ *
+ **********************************************************************************/
+#ifndef _WIN32
+
+struct HeadlessContext
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+/**
+ * Whether name is one of the space separated names in extensions.
+ */
+static bool hasExtension(const char* extensions, const char* name)
+{
+    size_t length = strlen(name);
+
+    for (const char* p = extensions; p && (p = strstr(p, name)); p += length)
+    {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Initialised display that needs no window system: Mesa's surfaceless
+ * platform, else the first GPU device, as the NVIDIA driver offers.
+ */
+static EGLDisplay headlessDisplay()
+{
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+
+    if (!getPlatformDisplay)
+        return EGL_NO_DISPLAY;
+
+    std::vector<EGLDisplay> candidates;
+
+    if (hasExtension(extensions, "EGL_MESA_platform_surfaceless"))
+        candidates.push_back(getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL));
+
+    EGLDeviceEXT device;
+    EGLint deviceCount = 0;
+
+    if (queryDevices && hasExtension(extensions, "EGL_EXT_platform_device") &&
+        queryDevices(1, &device, &deviceCount) && deviceCount > 0)
+        candidates.push_back(getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL));
+
+    for (EGLDisplay display : candidates)
+    {
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+            return display;
+    }
+    return EGL_NO_DISPLAY;
+}
+
+HeadlessContext* createHeadlessContext(bool software)
+{
+    if (software)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+
+    EGLDisplay display = headlessDisplay();
+
+    if (display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "ERROR: no EGL display without a window system\n");
+        return nullptr;
+    }
+
+    // Everything is drawn to framebuffer objects, so the context is made
+    // current without any surface.
+    if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context") ||
+        !eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "ERROR: EGL display has no surfaceless OpenGL contexts\n");
+        eglTerminate(display);
+        return nullptr;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, HOPF_GL_MAJOR,
+        EGL_CONTEXT_MINOR_VERSION, HOPF_GL_MINOR,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    if (eglChooseConfig(display, configAttribs, &config, 1, &configCount) && configCount > 0)
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "ERROR: could not create an OpenGL %d.%d context (EGL error 0x%x)\n",
+            HOPF_GL_MAJOR, HOPF_GL_MINOR, eglGetError());
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        return nullptr;
+    }
+
+    HeadlessContext* headless = new HeadlessContext{display, context};
+
+    // glewInit would also look for a GLX display, which there is none of.
+    glewExperimental = GL_TRUE;
+    GLenum error = glewContextInit();
+
+    if (error != GLEW_OK) {
+        fprintf(stderr, "ERROR: could not load OpenGL functions: %s\n", (const char*)glewGetErrorString(error));
+        destroyHeadlessContext(headless);
+        return nullptr;
+    }
+
+    if (!checkGLVersion()) {
+        destroyHeadlessContext(headless);
+        return nullptr;
+    }
+    glState().invalidate();
+    bufferHazards().invalidate();
+
+    return headless;
+}
+
+void destroyHeadlessContext(HeadlessContext* headless)
+{
+    eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(headless->display, headless->context);
+    eglTerminate(headless->display);
+    delete headless;
+}
+
+#else
+
+// Windows needs no display server for a hidden window.
+struct HeadlessContext
+{
+    GLFWwindow* window;
+};
+
+HeadlessContext* createHeadlessContext(bool software)
+{
+    if (software)
+        _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: could not start GLFW3\n");
+        return nullptr;
+    }
+
+    // The window is never shown; everything is drawn to framebuffer objects.
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, HOPF_GL_MAJOR);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, HOPF_GL_MINOR);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "hopf_offscreen", NULL, NULL);
+
+    if (!window) {
+        fprintf(stderr, "ERROR: could not create a GL context\n");
+        glfwTerminate();
+        return nullptr;
+    }
+
+    HeadlessContext* headless = new HeadlessContext{window};
+
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    if (!checkGLVersion()) {
+        destroyHeadlessContext(headless);
+        return nullptr;
+    }
+    glState().invalidate();
+    bufferHazards().invalidate();
+
+    return headless;
+}
+
+void destroyHeadlessContext(HeadlessContext* headless)
+{
+    glfwDestroyWindow(headless->window);
+    glfwTerminate();
+    delete headless;
+}
+
+#endif
+
+/**********************************************************************************
+ *
+ * Implementation details for OffscreenTarget
+ *
+ **********************************************************************************/
+OffscreenTarget::~OffscreenTarget()
+{
+    glDeleteRenderbuffers(2, m_renderbuffers);
+    glDeleteFramebuffers(1, &m_framebuffer);
+}
+
+bool OffscreenTarget::create(int width, int height)
+{
+    if (!m_framebuffer)
+    {
+        glGenFramebuffers(1, &m_framebuffer);
+        glGenRenderbuffers(2, m_renderbuffers);
+    }
+
+    m_width = width;
+    m_height = height;
+
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!complete)
+        fprintf(stderr, "ERROR: incomplete %dx%d framebuffer\n", width, height);
+
+    return complete;
+}
+
+void OffscreenTarget::bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void OffscreenTarget::readPixels(std::vector<unsigned char>& rgb, int width, int height)
+{
+    rgb.resize((size_t)width*height*3);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+}
+
+/**********************************************************************************
+ *
+ * Implementation details for OffscreenScene
+ *
+ **********************************************************************************/
+static std::shared_ptr<SimulationParams> offscreenParams(int sampling)
+{
+    auto params = std::make_shared<SimulationParams>();
+    params->maxFibers = FIBER_COUNT;
+    params->drawMesh = samplingIsCurve(sampling);
+    params->drawLines = true;
+    params->sampling = sampling;
+    return params;
+}
+
+OffscreenScene::OffscreenScene(const std::string& shaderDir, int sampling, float curl, int width, int height) :
+    camera(vec3(1,0,0),vec3(-5,5,0),width,height,PI/4,0.01,20000),
+    m_shaderManager(std::make_shared<ShaderManager>(shaderDir)),
+    m_params(offscreenParams(sampling)),
+    m_arena(std::make_shared<GpuArena>()),
+    m_controller(m_shaderManager, m_params, m_arena),
+    m_display(m_shaderManager, m_params, m_arena)
+{
+    m_ready = addHopfPrograms(*m_shaderManager);
+    if (!m_ready) {
+        fprintf(stderr, "ERROR: could not link the scene programs\n");
+        return;
+    }
+
+    std::vector<vec3> positions = sampleBasePoints(sampling, FIBER_COUNT, curl);
+    std::vector<SpherePointData> points(FIBER_COUNT);
+    for (unsigned int i = 0; i < FIBER_COUNT; i++)
+        points[i].position = vec4(positions[i],1.0f);
+
+    m_controller.uploadPointData(points.data(),points.size()*sizeof(SpherePointData));
+    m_display.setPoints(m_controller.getPoints(), m_controller.getBasePoints());
+    m_display.updateIndexData(FIBER_COUNT, FIBER_SIZE);
+    m_display.setSurfaceCurve([curl](float t) {return spherePath(t, curl);});
+
+    // Pick up local sizes tuned by an earlier --autotune run, if any.
+    WorkGroupTuner tuner(HOPF_TUNING_FILE);
+    if (tuner.load())
+        m_display.applyTuning(tuner);
+}
+
+void OffscreenScene::update(const mat3& rotation)
+{
+    m_arena->beginFrame();
+
+    m_controller.updateBallPositions(rotation);
+    m_display.setRotation(rotation);
+
+    m_display.updateFiberData();
+}
+
+void OffscreenScene::render()
+{
+    camera.updateUbo();
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_display.render(camera);
+}
@@ -0,0 +1,504 @@
+#include "pathtracer.h"
+
+#include <algorithm>
+#include <barrier>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "defines.h"
+#include "fiberbvh.h"
+#include "sampling.h"
+#include "timeline.h"
+
+// Rays further than this are taken to miss, as with the camera's far plane.
+#define TRACE_FAR 20000.0f
+
+// Distance hit points are lifted off the tube, so rays leaving it do not hit
+// it again.
+#define SURFACE_OFFSET 1e-4f
+
+static const vec3 skyZenith = vec3(0.35f, 0.45f, 0.65f);
+static const vec3 skyHorizon = vec3(0.75f, 0.78f, 0.82f);
+static const vec3 skyGround = vec3(0.25f, 0.23f, 0.21f);
+static const vec3 sunColor = vec3(1.0f, 0.93f, 0.82f);
+static const vec3 sunDirection = glm::normalize(vec3(-0.5f, 0.3f, 0.8f));
+
+// Seen where camera rays miss; the raster path clears to black too.
+static const vec3 background = vec3(0);
+
+/**********************************************************************************
+ *
+ * Command line
+ *
+ **********************************************************************************/
+static void printTraceUsage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s --trace [--size <w>x<h>] [--passes <n>] [--bounces <n>] [--threads <n>]\n"
+        "          [--tile <n>] [--save-every <n>] [--time <s>] [--out <file>] [--speed <rev/s>]\n"
+        "          [--sampling <mode>] [--curl <c>] [--radius <r>] [--sun-size <deg>]\n", program);
+}
+
+bool parseTraceOptions(int argc, char** argv, TraceOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i],"--trace"))
+            continue;
+        else if (!strcmp(argv[i],"--size") && hasValue)
+        {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+                options.width = 0;
+        }
+        else if (!strcmp(argv[i],"--passes") && hasValue)
+            options.passes = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--bounces") && hasValue)
+            options.bounces = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--threads") && hasValue)
+            options.threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--tile") && hasValue)
+            options.tileSize = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--save-every") && hasValue)
+            options.saveEvery = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--time") && hasValue)
+            options.time = atof(argv[++i]);
+        else if (!strcmp(argv[i],"--out") && hasValue)
+            options.output = argv[++i];
+        else if (!strcmp(argv[i],"--speed") && hasValue)
+            options.animSpeed = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--sampling") && hasValue)
+            options.sampling = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--curl") && hasValue)
+            options.curl = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--radius") && hasValue)
+            options.tubeRadius = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--sun-size") && hasValue)
+            options.sunSize = (float)atof(argv[++i]);
+        else
+        {
+            printTraceUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.width <= 0 || options.height <= 0 || options.passes <= 0 || options.bounces < 0 ||
+        options.threads < 0 || options.tileSize <= 0 || options.saveEvery < 0 ||
+        options.tubeRadius <= 0 || options.sunSize < 0)
+    {
+        printTraceUsage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+/**********************************************************************************
+ *
+ * Sampling
+ *
+ **********************************************************************************/
+
+/**
+ * Stateless random numbers for one pixel sample: the value of each dimension
+ * depends only on the pixel, the pass and the dimension, so images do not
+ * depend on which thread traced which tile.
+ */
+struct PixelSampler
+{
+    uint64_t key = 0;
+    uint32_t dimension = 0;
+
+    PixelSampler() {}
+    PixelSampler(uint64_t pixel, uint32_t pass) : key(pixel*0x100000001B3ull + pass) {}
+
+    float next()
+    {
+        uint64_t x = key*0x9E3779B97F4A7C15ull + dimension++;
+        x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27))*0x94D049BB133111EBull;
+        x = x ^ (x >> 31);
+        return (float)(x >> 40)/(float)(1ull << 24);
+    }
+};
+
+// Unit vectors t,b with (t,b,n) orthonormal, for unit n.
+static void orthonormalBasis(vec3 n, vec3& t, vec3& b)
+{
+    float s = std::copysign(1.0f, n.z);
+    float a = -1/(s + n.z);
+    float c = n.x*n.y*a;
+    t = vec3(1 + s*n.x*n.x*a, s*c, -s*n.x);
+    b = vec3(c, s + n.y*n.y*a, -n.y);
+}
+
+// Direction about n with density proportional to the cosine with n.
+static vec3 sampleCosine(vec3 n, float u, float v)
+{
+    vec3 t, b;
+    orthonormalBasis(n, t, b);
+
+    float r = std::sqrt(u);
+    float phi = 2*PI*v;
+    return r*std::cos(phi)*t + r*std::sin(phi)*b + std::sqrt(std::max(0.0f, 1 - u))*n;
+}
+
+// Uniform direction in the cone about axis with the given cosine of its half angle.
+static vec3 sampleCone(vec3 axis, float cosAngle, float u, float v)
+{
+    vec3 t, b;
+    orthonormalBasis(axis, t, b);
+
+    float cosTheta = 1 - u*(1 - cosAngle);
+    float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta*cosTheta));
+    float phi = 2*PI*v;
+    return sinTheta*std::cos(phi)*t + sinTheta*std::sin(phi)*b + cosTheta*axis;
+}
+
+/**********************************************************************************
+ *
+ * Scene
+ *
+ **********************************************************************************/
+
+struct TraceScene
+{
+    FiberBVH bvh;
+    std::vector<vec3> albedo;       // Linear colour of each fiber
+    float sunCosAngle;
+    int bounces;
+};
+
+// Same colours as spheres_transform.comp, which the raster path draws with.
+static vec3 sphereToColor(vec3 p)
+{
+    float hue = std::atan2(p.x, p.y)/(2*PI);
+    vec3 rgb;
+
+    for (int c = 0; c < 3; c++)
+    {
+        float k = hue + (float)(3 - c)/3.0f;
+        float f = std::abs((k - std::floor(k))*6 - 3);
+        rgb[c] = std::clamp(f - 1, 0.0f, 1.0f);
+    }
+    return glm::normalize(glm::abs(p) + rgb);
+}
+
+static vec3 skyRadiance(vec3 dir)
+{
+    if (dir.z >= 0)
+        return glm::mix(skyHorizon, skyZenith, dir.z);
+    return glm::mix(skyHorizon, skyGround, std::min(-4*dir.z, 1.0f));
+}
+
+/**
+ * Light reaching the camera from the first hit of a camera ray, following
+ * diffuse bounces.  The sun is sampled directly at every hit; the sky is seen
+ * only by bounce rays that escape, which is what darkens occluded creases.
+ */
+static vec3 tracePath(const TraceScene& scene, vec3 origin, vec3 dir, RayHit hit, PixelSampler& sampler)
+{
+    vec3 radiance(0);
+    vec3 throughput(1);
+
+    for (int bounce = 0; ; bounce++)
+    {
+        vec3 albedo = scene.albedo[scene.bvh.segment(hit.segment).fiber];
+        vec3 p = origin + hit.t*dir;
+        vec3 n = scene.bvh.normal(hit.segment, p);
+
+        if (glm::dot(n, dir) > 0)
+            n = -n;
+        p += SURFACE_OFFSET*n;
+
+        float u = sampler.next();
+        float v = sampler.next();
+        vec3 toSun = sampleCone(sunDirection, scene.sunCosAngle, u, v);
+        float cosine = glm::dot(n, toSun);
+
+        if (cosine > 0 && !scene.bvh.occluded({p, toSun, TRACE_FAR}))
+            radiance += throughput*albedo*sunColor*cosine;
+
+        if (bounce == scene.bounces)
+            break;
+
+        // The cosine in the density cancels the one in the diffuse BRDF.
+        u = sampler.next();
+        v = sampler.next();
+        origin = p;
+        dir = sampleCosine(n, u, v);
+        throughput *= albedo;
+
+        if (!scene.bvh.intersect({origin, dir, TRACE_FAR}, hit))
+        {
+            radiance += throughput*skyRadiance(dir);
+            break;
+        }
+    }
+
+    return radiance;
+}
+
+/**********************************************************************************
+ *
+ * Work stealing
+ *
+ **********************************************************************************/
+
+/**
+ * One queue of tiles per worker.  Each worker takes its own tiles from the
+ * front, in image order, and when it runs out steals from the back of the
+ * others', away from where their owners are working.
+ */
+class TileQueues
+{
+public:
+    TileQueues(unsigned workers) : m_queues(workers) {}
+
+    /**
+     * Deal tiles [0,count) out in contiguous runs, so each worker keeps to
+     * the same part of the image from pass to pass.
+     */
+    void fill(uint32_t count)
+    {
+        size_t workers = m_queues.size();
+
+        for (size_t w = 0; w < workers; w++)
+        {
+            std::lock_guard<std::mutex> lock(m_queues[w].mutex);
+            for (uint32_t tile = (uint32_t)(w*count/workers); tile < (w + 1)*count/workers; tile++)
+                m_queues[w].tiles.push_back(tile);
+        }
+    }
+
+    bool pop(unsigned worker, uint32_t& tile)
+    {
+        size_t workers = m_queues.size();
+
+        for (size_t i = 0; i < workers; i++)
+        {
+            Queue& queue = m_queues[(worker + i) % workers];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (queue.tiles.empty())
+                continue;
+
+            if (i == 0) {
+                tile = queue.tiles.front();
+                queue.tiles.pop_front();
+            } else {
+                tile = queue.tiles.back();
+                queue.tiles.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> tiles;
+    };
+
+    std::vector<Queue> m_queues;
+};
+
+/**********************************************************************************
+ *
+ * Rendering
+ *
+ **********************************************************************************/
+
+/**
+ * Write the mean of passes samples per pixel, gamma encoded, as a PPM.
+ */
+static bool writeImage(const std::string& path, const std::vector<vec3>& sum, int width, int height, int passes)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+
+    if (!file) {
+        fprintf(stderr, "ERROR: could not open file: %s \n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    std::vector<unsigned char> row((size_t)width*3);
+    bool ok = true;
+
+    for (int y = 0; y < height && ok; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            vec3 color = sum[(size_t)y*width + x]/(float)passes;
+            for (int c = 0; c < 3; c++)
+                row[3*x + c] = (unsigned char)(std::pow(std::clamp(color[c], 0.0f, 1.0f), 1/2.2f)*255 + 0.5f);
+        }
+        ok = fwrite(row.data(), 3, width, file) == (size_t)width;
+    }
+
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "ERROR: failed writing %s \n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+int runTraceRender(const TraceOptions& options)
+{
+    const int W = options.width;
+    const int H = options.height;
+
+    AnimationTimeline timeline;
+    timeline.setSpeed(options.animSpeed, 0);
+    mat3 rotation = timeline.sphereRotation(options.time);
+
+    // Fibers over the same points, rotated and coloured as the raster path
+    // does, with the same number of samples per fiber.
+    TraceScene scene;
+    std::vector<vec3> points = sampleBasePoints(options.sampling, FIBER_COUNT, options.curl);
+
+    for (vec3& p : points)
+    {
+        p = rotation*p;
+
+        // Raster colours are display values; light works on linear ones.
+        vec3 color = sphereToColor(p);
+        scene.albedo.push_back(vec3(std::pow(color.x, 2.2f), std::pow(color.y, 2.2f), std::pow(color.z, 2.2f)));
+    }
+
+    scene.bvh.build(fiberSegments(points, FIBER_SIZE, options.tubeRadius));
+    scene.sunCosAngle = std::cos(options.sunSize*PI/180);
+    scene.bounces = options.bounces;
+
+    // Camera rays start at the eye and pass through the unprojected pixel.
+    Camera camera(vec3(1,0,0),vec3(-5,5,0),W,H,PI/4,0.01,20000);
+    mat4 view = camera.getViewMatrix();
+    mat4 toWorld = glm::inverse(view);
+    mat4 invProj = glm::inverse(camera.getProjMatrix());
+    vec3 eye = vec3(toWorld[3]);
+
+    auto cameraRay = [&](float x, float y) -> Ray
+    {
+        vec4 p = invProj*vec4(2*x/W - 1, 1 - 2*y/H, 1, 1);
+        vec3 dir = glm::normalize(vec3(toWorld*vec4(vec3(p)/p.w, 0)));
+        return {eye, dir, TRACE_FAR};
+    };
+
+    unsigned workers = options.threads ? (unsigned)options.threads : std::max(1u, std::thread::hardware_concurrency());
+    int tile = options.tileSize;
+    int tilesX = (W + tile - 1)/tile;
+    int tilesY = (H + tile - 1)/tile;
+    uint32_t tileCount = (uint32_t)(tilesX*tilesY);
+
+    printf("Tracing %dx%d image, %d passes, %zu segments in %zu nodes, %u threads\n",
+        W, H, options.passes, scene.bvh.segmentCount(), scene.bvh.nodeCount(), workers);
+
+    // Each pixel belongs to one tile, so workers never add to the same sum.
+    std::vector<vec3> sum((size_t)W*H, vec3(0));
+    TileQueues queues(workers);
+    queues.fill(tileCount);
+
+    int pass = 0;
+    bool done = false;
+    bool ok = true;
+
+    auto renderTile = [&](uint32_t index)
+    {
+        int x0 = (int)(index % tilesX)*tile, x1 = std::min(x0 + tile, W);
+        int y0 = (int)(index / tilesX)*tile, y1 = std::min(y0 + tile, H);
+
+        for (int y = y0; y < y1; y++)
+        {
+            // Neighbouring camera rays are coherent, so trace them as packets.
+            for (int x = x0; x < x1; x += RAY_PACKET_SIZE)
+            {
+                int lanes = std::min(RAY_PACKET_SIZE, x1 - x);
+                RayPacket packet;
+                Ray rays[RAY_PACKET_SIZE];
+                PixelSampler samplers[RAY_PACKET_SIZE];
+
+                for (int lane = 0; lane < RAY_PACKET_SIZE; lane++)
+                {
+                    // Spare lanes repeat the last ray and are ignored.
+                    int px = x + std::min(lane, lanes - 1);
+                    samplers[lane] = PixelSampler((uint64_t)y*W + px, (uint32_t)pass);
+
+                    float u = samplers[lane].next();
+                    float v = samplers[lane].next();
+                    rays[lane] = cameraRay(px + u, y + v);
+                    packet.set(lane, rays[lane]);
+                }
+
+                scene.bvh.intersect(packet);
+
+                for (int lane = 0; lane < lanes; lane++)
+                {
+                    vec3 color = background;
+
+                    if (packet.segment[lane] != FIBER_BVH_MISS)
+                    {
+                        RayHit hit;
+                        hit.t = packet.tMax[lane];
+                        hit.segment = packet.segment[lane];
+                        color = tracePath(scene, rays[lane].origin, rays[lane].dir, hit, samplers[lane]);
+                    }
+                    sum[(size_t)y*W + x + lane] += color;
+                }
+            }
+        }
+    };
+
+    // Runs on one thread once all tiles of a pass are done, before any
+    // worker starts the next.
+    auto endPass = [&]() noexcept
+    {
+        pass++;
+        printf("\rpass %d/%d", pass, options.passes);
+        fflush(stdout);
+
+        done = pass == options.passes;
+
+        if (done || (options.saveEvery && pass % options.saveEvery == 0))
+            ok = writeImage(options.output, sum, W, H, pass) && ok;
+
+        if (!done)
+            queues.fill(tileCount);
+    };
+
+    std::barrier passBarrier((std::ptrdiff_t)workers, endPass);
+
+    auto work = [&](unsigned worker)
+    {
+        while (!done)
+        {
+            uint32_t index;
+            while (queues.pop(worker, index))
+                renderTile(index);
+
+            passBarrier.arrive_and_wait();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < workers; w++)
+        threads.emplace_back(work, w);
+
+    work(0);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    printf("\n");
+    return ok ? 0 : 1;
+}
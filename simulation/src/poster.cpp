@@ -0,0 +1,236 @@
+#include "poster.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "defines.h"
+#include "offscreen.h"
+#include "sampling.h"
+#include "timeline.h"
+
+// Poster files easily pass 2 GB
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+/**********************************************************************************
+ *
+ * Command line
+ *
+ **********************************************************************************/
+static void printPosterUsage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s --poster [--size <w>x<h>] [--tile <n>] [--supersample <n>] [--time <s>]\n"
+        "          [--out <file>] [--shaders <dir>] [--speed <rev/s>] [--sampling <mode>]\n"
+        "          [--curl <c>] [--lines <px>] [--additive] [--no-mesh] [--surface]\n"
+        "          [--software]\n", program);
+}
+
+bool parsePosterOptions(int argc, char** argv, PosterOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i],"--poster"))
+            continue;
+        else if (!strcmp(argv[i],"--size") && hasValue)
+        {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+                options.width = 0;
+        }
+        else if (!strcmp(argv[i],"--tile") && hasValue)
+            options.tileSize = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--supersample") && hasValue)
+            options.supersample = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--time") && hasValue)
+            options.time = atof(argv[++i]);
+        else if (!strcmp(argv[i],"--out") && hasValue)
+            options.output = argv[++i];
+        else if (!strcmp(argv[i],"--shaders") && hasValue)
+            options.shaderDir = argv[++i];
+        else if (!strcmp(argv[i],"--speed") && hasValue)
+            options.animSpeed = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--sampling") && hasValue)
+            options.sampling = atoi(argv[++i]);
+        else if (!strcmp(argv[i],"--curl") && hasValue)
+            options.curl = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--lines") && hasValue)
+            options.lineWidth = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i],"--additive"))
+            options.additive = true;
+        else if (!strcmp(argv[i],"--no-mesh"))
+            options.noMesh = true;
+        else if (!strcmp(argv[i],"--surface"))
+            options.surface = true;
+        else if (!strcmp(argv[i],"--software"))
+            options.software = true;
+        else
+        {
+            printPosterUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.width <= 0 || options.height <= 0 || options.tileSize <= 0 || options.supersample <= 0)
+    {
+        printPosterUsage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
+/**********************************************************************************
+ *
+ * Rendering
+ *
+ **********************************************************************************/
+
+/**
+ * Box filter one row of output pixels from an ss x ss supersampled tile.
+ * Tile rows are bottom first, as read back from GL.
+ */
+static void resolveRow(const unsigned char* tile, int tileWidth, int ss, int sourceRow, int width, unsigned char* out)
+{
+    const int samples = ss*ss;
+
+    for (int x = 0; x < width; x++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            int sum = 0;
+            for (int sy = 0; sy < ss; sy++)
+            {
+                const unsigned char* row = tile + ((size_t)(sourceRow + sy)*tileWidth + (size_t)x*ss)*3;
+                for (int sx = 0; sx < ss; sx++)
+                    sum += row[3*sx + c];
+            }
+            out[3*x + c] = (unsigned char)((sum + samples/2)/samples);
+        }
+    }
+}
+
+static int renderPoster(const PosterOptions& options)
+{
+    const int ss = options.supersample;
+    const int W = options.width;
+    const int H = options.height;
+
+    // One tile, supersampled, has to fit in a renderbuffer and a viewport.
+    GLint maxRenderbuffer, maxViewport[2];
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+
+    int maxTile = std::min({maxRenderbuffer, maxViewport[0], maxViewport[1]})/ss;
+    int tile = std::min(options.tileSize, maxTile);
+
+    if (tile <= 0) {
+        fprintf(stderr, "ERROR: supersampling %d exceeds the maximum framebuffer size %d\n", ss, maxRenderbuffer);
+        return 1;
+    }
+
+    // The camera aspect is that of the whole poster; tiles only narrow the frustum.
+    OffscreenScene scene(options.shaderDir, options.sampling, options.curl, W, H);
+    OffscreenTarget target;
+
+    if (!scene.ready())
+        return 1;
+
+    // Line widths are in output pixels, so they scale with the supersampling.
+    SimulationParams& params = scene.params();
+    params.drawMesh = !options.noMesh && samplingIsCurve(options.sampling);
+    params.drawSurface = options.surface;
+    params.pixelScale = (float)ss;
+    if (options.lineWidth > 0)
+    {
+        params.tubeMode = TUBES_LINES;
+        params.lineWidth = options.lineWidth;
+        params.lineAdditive = options.additive;
+    }
+
+    if (!target.create(tile*ss, tile*ss))
+        return 1;
+
+    AnimationTimeline timeline;
+    timeline.setSpeed(options.animSpeed, 0);
+    scene.update(timeline.sphereRotation(options.time));
+
+    FILE* file = fopen(options.output.c_str(), "wb");
+
+    if (!file) {
+        fprintf(stderr, "ERROR: could not open file: %s \n", options.output.c_str());
+        return 1;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", W, H);
+    long long header = ftell(file);
+
+    int tilesX = (W + tile - 1)/tile;
+    int tilesY = (H + tile - 1)/tile;
+
+    printf("Rendering %dx%d poster in %dx%d tiles of %d px (%dx supersampling)\n", W, H, tilesX, tilesY, tile, ss);
+
+    std::vector<unsigned char> pixels;
+    std::vector<unsigned char> row((size_t)tile*3);
+    bool ok = true;
+
+    for (int ty = 0; ty < tilesY && ok; ty++)
+    {
+        for (int tx = 0; tx < tilesX && ok; tx++)
+        {
+            // Pixel rect of the tile, with y counted down from the top row.
+            int x0 = tx*tile, x1 = std::min(x0 + tile, W);
+            int y0 = ty*tile, y1 = std::min(y0 + tile, H);
+            int tileW = x1 - x0, tileH = y1 - y0;
+
+            scene.camera.setSubFrustum(
+                vec2(-1 + 2*(float)x0/W, 1 - 2*(float)y1/H),
+                vec2(-1 + 2*(float)x1/W, 1 - 2*(float)y0/H));
+
+            target.bind();
+            glViewport(0, 0, tileW*ss, tileH*ss);
+            scene.render();
+            target.readPixels(pixels, tileW*ss, tileH*ss);
+
+            for (int r = 0; r < tileH && ok; r++)
+            {
+                resolveRow(pixels.data(), tileW*ss, ss, (tileH - 1 - r)*ss, tileW, row.data());
+
+                long long offset = header + ((long long)(y0 + r)*W + x0)*3;
+                ok = fseek64(file, offset, SEEK_SET) == 0 && fwrite(row.data(), 3, tileW, file) == (size_t)tileW;
+            }
+
+            printf("\r%d/%d tiles", ty*tilesX + tx + 1, tilesX*tilesY);
+            fflush(stdout);
+        }
+    }
+    printf("\n");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "ERROR: failed writing %s \n", options.output.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int runPosterRender(const PosterOptions& options)
+{
+    HeadlessContext* context = createHeadlessContext(options.software);
+    if (!context)
+        return 1;
+
+    // GL objects must go before the context does.
+    int result = renderPoster(options);
+
+    destroyHeadlessContext(context);
+    return result;
+}
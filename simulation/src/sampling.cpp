@@ -0,0 +1,338 @@
+#include "sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "misc.h"
+
+/**********************************************************************************
+ *
+ * Helper functions
+ *
+ **********************************************************************************/
+static const float TWO_PI = 2*PI;
+
+static float wrapAngle(float phi)
+{
+    phi = std::fmod(phi, TWO_PI);
+    return phi < 0 ? phi + TWO_PI : phi;
+}
+
+static vec3 fromZPhi(float z, float phi)
+{
+    float r = std::sqrt(std::max(0.0f, 1 - z*z));
+    return vec3(r*std::cos(phi), r*std::sin(phi), z);
+}
+
+// Stateless hash to [0,1), so parallel workers need no shared RNG.
+static float hashUniform(uint32_t seed, uint64_t index)
+{
+    uint64_t x = index + 0x9E3779B97F4A7C15ull*(seed + 1);
+    x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27))*0x94D049BB133111EBull;
+    x = x ^ (x >> 31);
+    return (float)(x >> 40)/(float)(1ull << 24);
+}
+
+// Spread the low 10 bits of v so there are two zero bits between each.
+static uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/**********************************************************************************
+ *
+ * SphereRegion
+ *
+ **********************************************************************************/
+bool SphereRegion::contains(float theta, float phi) const
+{
+    if (theta < thetaMin || theta > thetaMax)
+        return false;
+
+    float range = phiMax - phiMin;
+    if (range >= TWO_PI)
+        return true;
+
+    return wrapAngle(phi - phiMin) <= range;
+}
+
+float SphereRegion::area() const
+{
+    float range = std::min(phiMax - phiMin, TWO_PI);
+    return (std::cos(thetaMin) - std::cos(thetaMax))*range;
+}
+
+/**********************************************************************************
+ *
+ * Generators
+ *
+ **********************************************************************************/
+std::vector<vec3> sampleFibonacci(size_t count, const SphereRegion& region, unsigned threads)
+{
+    std::vector<vec3> points(count);
+
+    const double golden = 0.5*(std::sqrt(5.0) - 1.0);
+
+    float zMax = std::cos(region.thetaMin);
+    float zMin = std::cos(region.thetaMax);
+    float phiRange = std::min(region.phiMax - region.phiMin, TWO_PI);
+
+    parallelFor(count, threads, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            // Area is uniform in z and phi, so an even spread in both is
+            // an even spread over the region.
+            float z = zMax - (zMax - zMin)*((float)i + 0.5f)/(float)count;
+            double frac = (double)i*golden;
+            float phi = region.phiMin + phiRange*(float)(frac - std::floor(frac));
+            points[i] = fromZPhi(z, phi);
+        }
+    });
+
+    return points;
+}
+
+std::vector<vec3> sampleEqualArea(size_t nside, const SphereRegion& region, unsigned threads)
+{
+    nside = std::max<size_t>(nside, 1);
+
+    const size_t npix = 12*nside*nside;
+    const size_t ncap = 2*nside*(nside - 1);
+    const double fact2 = 4.0/(double)npix;
+    const double fact1 = 2.0*(double)nside*fact2;
+    const double halfPi = 0.5*PI;
+
+    // Each chunk keeps its own output so the results can be joined in order.
+    unsigned chunks = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::vector<vec3>> partial(chunks);
+
+    parallelFor(npix, chunks, [&](size_t begin, size_t end, size_t chunk)
+    {
+        std::vector<vec3>& out = partial[chunk];
+
+        for (size_t ipix = begin; ipix < end; ipix++)
+        {
+            double z, phi;
+
+            // HEALPix RING scheme cell centers
+            if (ipix < ncap)
+            {
+                size_t iring = (1 + (size_t)std::sqrt(1.0 + 2.0*(double)ipix)) >> 1;
+                size_t iphi = ipix + 1 - 2*iring*(iring - 1);
+                z = 1.0 - (double)(iring*iring)*fact2;
+                phi = ((double)iphi - 0.5)*halfPi/(double)iring;
+            }
+            else if (ipix < npix - ncap)
+            {
+                size_t ip = ipix - ncap;
+                size_t tmp = ip/(4*nside);
+                size_t iring = tmp + nside;
+                size_t iphi = ip - tmp*4*nside + 1;
+                double fodd = ((iring + nside) & 1) ? 1.0 : 0.5;
+                z = ((double)(2*nside) - (double)iring)*fact1;
+                phi = ((double)iphi - fodd)*PI/(double)(2*nside);
+            }
+            else
+            {
+                size_t ip = npix - ipix;
+                size_t iring = (1 + (size_t)std::sqrt(2.0*(double)ip - 1.0)) >> 1;
+                size_t iphi = 4*iring + 1 - (ip - 2*iring*(iring - 1));
+                z = -1.0 + (double)(iring*iring)*fact2;
+                phi = ((double)iphi - 0.5)*halfPi/(double)iring;
+            }
+
+            float theta = (float)std::acos(std::clamp(z, -1.0, 1.0));
+
+            if (region.contains(theta, (float)phi))
+                out.push_back(fromZPhi((float)z, (float)phi));
+        }
+    });
+
+    std::vector<vec3> points;
+    for (auto& out : partial)
+        points.insert(points.end(), out.begin(), out.end());
+
+    return points;
+}
+
+size_t equalAreaResolution(size_t count, const SphereRegion& region)
+{
+    float fraction = region.area()/(4*PI);
+    if (fraction <= 0)
+        return 1;
+
+    size_t nside = std::max<size_t>(1, (size_t)std::ceil(std::sqrt((double)count/(12.0*fraction))));
+
+    // Cell centers only approximate the region boundary, so grow until the
+    // region really holds enough cells.
+    while (sampleEqualArea(nside, region).size() < count)
+        nside++;
+
+    return nside;
+}
+
+std::vector<vec3> sampleLatitudeBands(size_t count, const SphereRegion& region, bool jitter, uint32_t seed, unsigned threads)
+{
+    std::vector<vec3> points(count);
+    if (!count)
+        return points;
+
+    float zMax = std::cos(region.thetaMin);
+    float zMin = std::cos(region.thetaMax);
+    float phiRange = std::min(region.phiMax - region.phiMin, TWO_PI);
+
+    // Bands of equal height in z have equal area; pick the band count so
+    // that cells are roughly square.
+    float zRange = zMax - zMin;
+    size_t bands = (size_t)std::lround(std::sqrt((double)count*zRange/std::max(phiRange, 1e-6f)));
+    bands = std::clamp<size_t>(bands, 1, count);
+
+    size_t base = count/bands;
+    size_t rem = count%bands;
+
+    parallelFor(count, threads, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            // The first rem bands hold one extra point.
+            size_t band, cell, cells;
+            if (i < rem*(base + 1))
+            {
+                band = i/(base + 1);
+                cell = i%(base + 1);
+                cells = base + 1;
+            }
+            else
+            {
+                band = rem + (i - rem*(base + 1))/base;
+                cell = (i - rem*(base + 1))%base;
+                cells = base;
+            }
+
+            float u = jitter ? hashUniform(seed, 2*i)     : 0.5f;
+            float v = jitter ? hashUniform(seed, 2*i + 1) : 0.5f;
+
+            float z = zMax - zRange*((float)band + u)/(float)bands;
+            float phi = region.phiMin + phiRange*((float)cell + v)/(float)cells;
+
+            points[i] = fromZPhi(z, phi);
+        }
+    });
+
+    return points;
+}
+
+/**********************************************************************************
+ *
+ * Ordering
+ *
+ **********************************************************************************/
+uint32_t mortonCode(vec3 p)
+{
+    auto quantize = [](float x)
+    {
+        return (uint32_t)std::clamp((x + 1.0f)*512.0f, 0.0f, 1023.0f);
+    };
+
+    return (expandBits(quantize(p.x)) << 2) | (expandBits(quantize(p.y)) << 1) | expandBits(quantize(p.z));
+}
+
+void sortSpaceFilling(std::vector<vec3>& points, unsigned threads)
+{
+    size_t count = points.size();
+
+    // Key in the high word, original index in the low word, so sorting is
+    // deterministic and stable.
+    std::vector<uint64_t> keys(count);
+
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    size_t chunks = std::min<size_t>(threads, std::max<size_t>(count, 1));
+
+    parallelFor(count, (unsigned)chunks, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; i++)
+            keys[i] = ((uint64_t)mortonCode(points[i]) << 32) | (uint64_t)i;
+
+        std::sort(keys.begin() + begin, keys.begin() + end);
+    });
+
+    // Merge the sorted chunks pairwise.
+    for (size_t width = 1; width < chunks; width *= 2)
+    {
+        for (size_t chunk = 0; chunk + width < chunks; chunk += 2*width)
+        {
+            size_t begin = count*chunk/chunks;
+            size_t middle = count*(chunk + width)/chunks;
+            size_t end = count*std::min(chunk + 2*width, chunks)/chunks;
+            std::inplace_merge(keys.begin() + begin, keys.begin() + middle, keys.begin() + end);
+        }
+    }
+
+    std::vector<vec3> sorted(count);
+
+    parallelFor(count, threads, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; i++)
+            sorted[i] = points[keys[i] & 0xFFFFFFFFu];
+    });
+
+    points.swap(sorted);
+}
+
+std::vector<vec3> strideSubset(const std::vector<vec3>& points, size_t count)
+{
+    size_t n = points.size();
+    count = std::min(count, n);
+
+    std::vector<vec3> subset(count);
+    for (size_t k = 0; k < count; k++)
+        subset[k] = points[k*n/count];
+
+    return subset;
+}
+
+vec3 spherePath(float t, float curl)
+{
+    t = 2*PI*t;
+    float s = PI/4 + curl*PI/4*sin(5*t);
+    return vec3(sin(s)*cos(t),sin(s)*sin(t),cos(s));
+}
+
+bool samplingIsCurve(int sampling)
+{
+    return sampling == SAMPLING_PATH;
+}
+
+std::vector<vec3> sampleBasePoints(int sampling, size_t count, float curl)
+{
+    std::vector<vec3> positions;
+
+    switch (sampling)
+    {
+    case SAMPLING_FIBONACCI:
+        positions = sampleFibonacci(count);
+        break;
+    case SAMPLING_EQUAL_AREA:
+        positions = sampleEqualArea(equalAreaResolution(count));
+        break;
+    case SAMPLING_LATITUDE_BANDS:
+        positions = sampleLatitudeBands(count);
+        break;
+    default:
+        for (size_t i = 0; i < count; i++)
+            positions.push_back(spherePath((float)i/(float)count, curl));
+        return positions;
+    }
+
+    // Keep neighbouring fibers adjacent in memory; the path is already ordered.
+    sortSpaceFilling(positions);
+    return strideSubset(positions, count);
+}
@@ -3,12 +3,18 @@
 #include "hopf.h"
 #include "imgui.h"
 #include "defines.h"
+#include "globject.h"
+#include "glstate.h"
+#include "sampling.h"
 #include "shader.h"
 #include "simulation.h"
 #include "ui.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -17,14 +23,15 @@
  * Main implementation
  * 
  **********************************************************************************/
-HopfSimulation::HopfSimulation(const char* title, int width, int height, int x, int y) : 
+HopfSimulation::HopfSimulation(const char* title, int width, int height, int x, int y, bool autotune) : 
     BaseViewWindow(title, width, height,x,y,NULL,NULL),
     ui(m_window),
     shaderManager(std::make_shared<ShaderManager>("../graphics/shader/")),
     params(std::make_shared<SimulationParams>()),
+    arena(std::make_shared<GpuArena>()),
     m_cameraUpdater(std::make_unique<CameraUpdater>(nullptr,3e-3,400)),
-    m_controller(shaderManager, params),
-    m_hopfDisplay(shaderManager, params)
+    m_controller(shaderManager, params, arena),
+    m_hopfDisplay(shaderManager, params, arena)
 {   
     m_controlViewport = Viewport(
         UI_PARAMS_PANEL_WIDTH, 
@@ -60,51 +67,28 @@ HopfSimulation::HopfSimulation(const char* title, int width, int height, int x,
     }
 
     initFiberData();
+    m_hopfDisplay.setPoints(m_controller.getPoints(), m_controller.getBasePoints());
+    m_hopfDisplay.updateIndexData(FIBER_COUNT, FIBER_SIZE);
+
+    WorkGroupTuner tuner(HOPF_TUNING_FILE);
+    tuner.load();
+
+    if (autotune)
+    {
+        printf("Tuning work group sizes on %s\n", tuner.renderer().c_str());
+        m_hopfDisplay.autotune(tuner);
+        tuner.save();
+    }
+    else
+    {
+        m_hopfDisplay.applyTuning(tuner);
+    }
+
     windowLoop();
 }
 
 bool HopfSimulation::initShaders() {
-    // Initialize shader programs and camera
-    shaderManager->addProgram(
-    "default",           
-    {"default.vert","solid_color.frag"});
-
-    shaderManager->addProgram(
-    "blinn-phong",       
-    {"default.vert","blinnphong.frag"});
-
-    shaderManager->addProgram(
-    "blinn-phong-instanced", 
-    {"spheres_instanced.vert","blinnphong.frag"});
-
-    shaderManager->addProgram(
-    "polyline_0_tangents",              
-    {"polyline_0_tangents.comp"});
-
-    shaderManager->addProgram(
-    "polyline_1_normals",              
-    {"polyline_1_normals.comp"});
-
-    shaderManager->addProgram(
-    "polyline_2_mesh",              
-    {"polyline_2_mesh.comp"});
-
-    shaderManager->addProgram(
-    "hopf",                  
-    {"hopf.comp"});
-
-    shaderManager->addProgram(
-    "spheres_transform",                
-    {"spheres_transform.comp"});
-
-    shaderManager->addProgram(
-    "mesh_normals", 
-    {"mesh_normals.comp"});
-
-    shaderManager->addProgram(
-    "mesh_normals_reset", 
-    {"mesh_normals_reset.comp"});
-    return true;
+    return addHopfPrograms(*shaderManager);
 }   
 
 float curl = 0;
@@ -114,22 +98,23 @@ bool HopfSimulation::initFiberData()
 {
     std::vector<SpherePointData> points(FIBER_COUNT);
 
-    auto spherePath = [](float t) 
-    {
-        t = 2*PI*t;
-        float s = PI/4 + curl*PI/4*sin(5*t);
-        return vec3(sin(s)*cos(t),sin(s)*sin(t),cos(s));
-    };
+    std::vector<vec3> positions = sampleBasePoints(params->sampling, FIBER_COUNT, curl);
 
     for (unsigned int i = 0; i < FIBER_COUNT; i++)
     {
-        float t = (float)i/(float)FIBER_COUNT;
-        points[i].position = vec4(spherePath(t),1.0f);
+        points[i].position = vec4(positions[i],1.0f);
     }
 
-    m_controller.uploadPointData(points.data(),points.size()*sizeof(SpherePointData));
-    m_hopfDisplay.setPoints(m_controller.getPoints());
-    m_hopfDisplay.updateIndexData(FIBER_COUNT, FIBER_SIZE);
+    m_basePositions = positions;
+    m_indexDirty = true;
+
+    // Only fibers over points that moved are regenerated.
+    for (uint i : m_controller.updatePointData(points))
+        m_hopfDisplay.markFiberDirty(i);
+
+    // The surface follows the path whatever the sampling.
+    m_hopfDisplay.setSurfaceCurve([c = curl](float t) {return spherePath(t, c);});
+
     return true; 
 }
 
@@ -141,6 +126,8 @@ void HopfSimulation::windowLoop()
 
     while (!glfwWindowShouldClose(m_window)) 
     {
+        glState().beginFrame();
+        arena->beginFrame();
     	glfwGetFramebufferSize(m_window, &m_width, &m_height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -170,11 +157,120 @@ void HopfSimulation::windowLoop()
 
 void HopfSimulation::updateSimulation()
 {
+    double time = glfwGetTime();
+
+    // The slider only changes the speed from now on; past motion is kept.
+    if (params->animSpeed != m_timeline.speed())
+        m_timeline.setSpeed(params->animSpeed, time);
+
     m_camera.updateUbo();
-    m_controller.updateBallPositions();
+    // A new rotation moves every point, and every fiber unless they move in
+    // S3; otherwise only edited fibers are dirty.
+    mat3 rotation = m_timeline.sphereRotation(time);
+    m_controller.updateBallPositions(rotation);
+    m_hopfDisplay.setRotation(rotation);
+    updateFiberIndex(rotation);
+
     m_hopfDisplay.updateFiberData();
 }
 
+void HopfSimulation::updateFiberIndex(const mat3& rotation)
+{
+    size_t count = std::min<size_t>(std::max(params->maxFibers, 0), m_basePositions.size());
+    bool moved = rotation != m_rotation || count != m_indexCount || m_indexDirty;
+    m_rotation = rotation;
+
+    bool built = m_indexBuild.valid() && m_indexBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    if (built)
+        m_fiberIndex = m_indexBuild.get();
+
+    // The fibers moved under the cursor, or can be picked again.
+    if (moved || built)
+        pickFiber();
+}
+
+bool HopfSimulation::fiberIndexReady()
+{
+    if (m_indexBuild.valid())
+    {
+        if (m_indexBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+        m_fiberIndex = m_indexBuild.get();
+    }
+
+    size_t count = std::min<size_t>(std::max(params->maxFibers, 0), m_basePositions.size());
+
+    std::vector<vec3> points;
+    if (m_indexDirty || count != m_indexCount || m_rotation != m_indexRotation)
+    {
+        points.resize(count);
+        for (size_t i = 0; i < count; i++)
+            points[i] = m_rotation*m_basePositions[i];
+    }
+
+    // New points need a new tree, which takes too long for the main thread;
+    // picks miss until it is done.
+    if (m_indexDirty || count != m_indexCount)
+    {
+        m_indexBuild = std::async(std::launch::async, [points = std::move(points)]()
+        {
+            FiberIndex index;
+            index.build(points, FIBER_PICK_RADIUS);
+            return index;
+        });
+
+        m_indexRotation = m_rotation;
+        m_indexCount = count;
+        m_indexDirty = false;
+        return false;
+    }
+
+    // A new rotation only refits the tree, which is cheap.
+    if (m_rotation != m_indexRotation)
+    {
+        m_fiberIndex.update(points);
+        m_indexRotation = m_rotation;
+    }
+
+    return true;
+}
+
+void HopfSimulation::pickFiber()
+{
+    uint32_t fiber = FIBER_BVH_MISS;
+    vec2 ndc = m_sceneViewport.getMouseNDC(m_mousePos);
+
+    if (std::abs(ndc.x) <= 1 && std::abs(ndc.y) <= 1)
+    {
+        // Unproject the far plane point under the mouse; the ray runs to it
+        // from the eye.
+        const Camera& camera = m_sceneViewport.camera;
+        mat4 toWorld = glm::inverse(camera.getViewMatrix());
+        vec4 p = glm::inverse(camera.getProjMatrix())*vec4(ndc.x,ndc.y,1,1);
+
+        Ray ray;
+        ray.origin = vec3(toWorld[3]);
+        ray.dir = glm::normalize(vec3(toWorld*vec4(vec3(p)/p.w,0)));
+        ray.tMax = camera.far;
+
+        float t;
+        if (fiberIndexReady())
+            fiber = m_fiberIndex.pick(ray, t);
+    }
+
+    m_hoveredFiber = fiber;
+
+    if (fiber == FIBER_BVH_MISS)
+    {
+        m_controller.setHighlight(-1);
+        m_hopfDisplay.clearHighlight();
+        return;
+    }
+
+    m_controller.setHighlight((int)fiber);
+    m_hopfDisplay.highlightFiber(m_indexRotation*m_basePositions[fiber]);
+}
+
 void HopfSimulation::sceneViewportRenderCallback(void* usr, Camera& camera)
 {
     HopfSimulation* sim = static_cast<HopfSimulation*>(usr);
@@ -210,6 +306,7 @@ void HopfSimulation::cursorPosCallback(GLFWwindow* window, double xpos, double y
 
 	win->m_mousePos = vec2(xpos,ypos);
     win->m_cameraUpdater.get()->rotate(xpos,ypos);	
+    win->pickFiber();
 }
 
 void HopfSimulation::renderUI()
@@ -246,14 +343,71 @@ void HopfSimulation::renderUI()
     {
         recalculatePoints = true;
     }
-    if (ImGui::Button(params->drawMesh ? "Disable mesh" : "Enable mesh"))
+    const char* samplingModes[] = {"Path", "Fibonacci lattice", "Equal-area cells", "Latitude bands"};
+    if (ImGui::Combo("Sampling",&params->sampling,samplingModes,4))
+    {
+        recalculatePoints = true;
+    }
+    // The mesh joins each fiber to the next, which only a path keeps close.
+    bool meshable = samplingIsCurve(params->sampling);
+    ImGui::BeginDisabled(!meshable);
+    if (ImGui::Button(params->drawMesh && meshable ? "Disable mesh" : "Enable mesh"))
     {
         params->drawMesh = !params->drawMesh;
     }
+    ImGui::EndDisabled();
+    if (!meshable)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(path sampling only)");
+    }
     if (ImGui::Button(params->drawLines ? "Disable lines" : "Enable lines"))
     {
         params->drawLines = !params->drawLines;
     }
+    if (ImGui::Checkbox("Fused fiber kernel", &params->fusedFibers))
+    {
+        m_hopfDisplay.markAllDirty();
+    }
+    const char* tubeModes[] = {"Mesh", "Ray-cast", "Lines"};
+    ImGui::Combo("Tubes",&params->tubeMode,tubeModes,3);
+    ImGui::Checkbox("Ray-cast points",&params->pointImpostors);
+    ImGui::Checkbox("Move fibers in S3",&params->fiberMotion);
+    if (m_hoveredFiber != FIBER_BVH_MISS)
+        ImGui::Text("Fiber under cursor: %u", m_hoveredFiber);
+    ImGui::Checkbox("Hopf surface",&params->drawSurface);
+    if (params->drawSurface)
+    {
+        ImGui::SliderFloat("Surface tolerance",&params->surfaceTolerance,1e-4f,1e-2f,"%.4f");
+        ImGui::Text("Surface: %zu vertices, %zu triangles", 
+            m_hopfDisplay.surfaceVertexCount(), m_hopfDisplay.surfaceTriangleCount());
+    }
+    if (params->tubeMode == TUBES_LINES)
+    {
+        ImGui::SliderFloat("Line width",&params->lineWidth,0.1f,8);
+        ImGui::SliderFloat("Line alpha",&params->lineAlpha,0,1);
+        ImGui::Checkbox("Additive lines",&params->lineAdditive);
+    }
+
+    const GLStateStats& binds = glState().lastFrame();
+    ImGui::Text("GL binds: %u issued, %u skipped", binds.issued, binds.skipped);
+    ImGui::Text("GL objects: %u buffers, %u vertex arrays",
+        glObjects().live(GL_OBJECT_BUFFER), glObjects().live(GL_OBJECT_VERTEX_ARRAY));
+    const RenderGraphStats& passes = m_hopfDisplay.graphStats();
+    ImGui::Text("Fiber update: %u passes, %u culled, %u barriers", passes.passes, passes.culled, passes.barriers);
+
+    if (ImGui::CollapsingHeader("GPU memory"))
+    {
+        const float MB = 1024.0f*1024.0f;
+
+        for (const auto& [subsystem, usage] : arena->usage())
+            ImGui::Text("%s: %.1f MB (peak %.1f MB)", subsystem.c_str(), usage.live/MB, usage.peak/MB);
+
+        if (arena->budget())
+            ImGui::Text("Reserved: %.1f of %.1f MB", arena->reserved()/MB, arena->budget()/MB);
+        else
+            ImGui::Text("Reserved: %.1f MB", arena->reserved()/MB);
+    }
 
 	ImGui::End();
 
@@ -0,0 +1,38 @@
+#include "timeline.h"
+
+#include <cmath>
+
+#include "misc.h"
+
+/**********************************************************************************
+ * 
+ * Implementation details for AnimationTimeline
+ * 
+ **********************************************************************************/
+void AnimationTimeline::setSpeed(double speed, double time)
+{
+    m_originPhase = phase(time);
+    m_originTime = time;
+    m_speed = speed;
+}
+
+void AnimationTimeline::seek(double time, double phase)
+{
+    m_originTime = time;
+    m_originPhase = phase;
+}
+
+double AnimationTimeline::phase(double time) const
+{
+    return m_originPhase + m_speed*(time - m_originTime);
+}
+
+mat3 AnimationTimeline::sphereRotation(double time) const
+{
+    // Reduce in double before converting, so the angle keeps full float
+    // precision after hours of animation.
+    double revolutions = phase(time);
+    double angle = 2*M_PI*(revolutions - std::floor(revolutions));
+
+    return rotation(vec3(1,0,1), (float)angle);
+}
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include <mutex>
 #include <time.h>
+#include <utility>
 
 ImGuiContextGLFW::ImGuiContextGLFW(GLFWwindow * window)
 {
@@ -42,14 +43,14 @@ Viewport::Viewport() :
 
 }
 
-Viewport::Viewport(int width, int height, ivec2 pos, Camera camera) :
+Viewport::Viewport(int width, int height, ivec2 pos, Camera&& camera) :
     pos(pos),
     size(ivec2(width,height)),
-    camera(camera),
+    camera(std::move(camera)),
     m_renderCallback(nullptr),
     m_behaviorCallback(nullptr)
 {
-    camera.resize(size.x, size.y);
+    this->camera.resize(size.x, size.y);
 }
 
 struct ScreenArea
@@ -130,6 +131,16 @@ ivec2 Viewport::getMousePos(ivec2 mousePosAbs)
     return flipy*(ivec2(mousePosAbs) - center);
 }
 
+vec2 Viewport::getMouseNDC(vec2 mousePosAbs)
+{
+    // render() draws below the title bar, into the bottom of the window.
+    ScreenArea area = convertToGLScreenCoords(pos, size, 0, 0);
+    vec2 corner = vec2(pos.x, pos.y + size.y - area.height);
+    vec2 rel = (mousePosAbs - corner)/vec2(area.width, area.height);
+
+    return vec2(2*rel.x - 1, 1 - 2*rel.y);
+}
+
 ivec2 Viewport::getCenterAbs()
 {
     return pos + size/2;
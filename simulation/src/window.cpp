@@ -1,4 +1,7 @@
 #include "window.h"
+#include "glstate.h"
+#include "rendergraph.h"
+#include <cstdlib>
 #include <thread>
 #include <tuple>
 
@@ -8,10 +11,14 @@ BaseViewWindow::BaseViewWindow(
 {
 
 	// Create glfw context
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, HOPF_GL_MAJOR);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, HOPF_GL_MINOR);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	m_window = glfwCreateWindow(m_width, m_height, title, monitor, share);
 	if (!m_window) {
 		fprintf(stderr, "ERROR: could not open window with GLFW3\n");
 		glfwTerminate();
+		exit(EXIT_FAILURE);
 	}
 	glfwMakeContextCurrent(m_window);
 	glfwSetWindowPos(m_window,xwin,ywin);
@@ -19,6 +26,15 @@ BaseViewWindow::BaseViewWindow(
 	// start GLEW extension handler
 	glewExperimental = GL_TRUE;
 	glewInit();
+
+	// Nothing below can run without the DSA entry points.
+	if (!checkGLVersion()) {
+		glfwDestroyWindow(m_window);
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+	glState().invalidate();
+	bufferHazards().invalidate();
 	
 	const GLubyte* _renderer = glGetString(GL_RENDERER);
 	const GLubyte* _version = glGetString(GL_VERSION);
@@ -1,5 +1,6 @@
 #include "misc.h"
 #include <GL/glew.h>
+#include <cmath>
 #include <iostream>
 #include "defines.h"
 
@@ -22,7 +23,8 @@ mat3 rotation(vec3 axis, float angle)
         -axis.y,   axis.x,   0
     );
 
-    mat3 rotation = exp(mat3(angle*differential));
+    // Rodrigues' formula, i.e. exp(angle*differential) without truncation.
+    mat3 rotation = mat3(1.0f) + std::sin(angle)*differential + (1 - std::cos(angle))*(differential*differential);
     return rotation;
 } 
 
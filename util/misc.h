@@ -2,6 +2,8 @@
 #define MISC_H
 
 #include <GL/glew.h>
+#include <algorithm>
+#include <thread>
 #include <vector>
 #include "defines.h"
 
@@ -51,4 +53,37 @@ static inline std::vector<T> lerp(T start, T end, int steps)
     }
     return out;
 }
+
+/**
+ * Split [0,count) into contiguous chunks and call fn(begin, end, chunk) for 
+ * each chunk on its own thread.  threads == 0 uses the hardware concurrency.
+ * Chunk boundaries depend only on count and the thread count.
+ */
+template<typename F>
+static inline void parallelFor(size_t count, unsigned threads, F&& fn)
+{
+    if (!threads) 
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    
+    size_t chunks = std::min<size_t>(threads, std::max<size_t>(count, 1));
+
+    if (chunks == 1)
+    {
+        fn((size_t)0, count, (size_t)0);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(chunks);
+
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+    {
+        size_t begin = count*chunk/chunks;
+        size_t end = count*(chunk + 1)/chunks;
+        workers.emplace_back([&fn, begin, end, chunk]() { fn(begin, end, chunk); });
+    }
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
 #endif
\ No newline at end of file